@@ -6,22 +6,143 @@
 
 /* Gives us high-resolution timers. */
 #define _POSIX_C_SOURCE 200809L
+/* Gives us realpath for identifying cached files. */
+#define _XOPEN_SOURCE 700
 #include <time.h>
+#include <sched.h>
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <omp.h>
+#include <immintrin.h>
+#ifdef FPT_MPI
+#include <mpi.h>
+#endif
 
 
 static int const DYN_ARRAY_INIT_CAPACITY = 32;
 
+/* Largest number of item pairs an FP-array is built for */
+static long const FP_ARRAY_MAX_PAIRS = 1 << 22;
+
+/* Number of itemsets handed to a thread at once during parallel rule generation */
+static int const RULE_CHUNK_SIZE = 256;
+
+/* Default size of blocks handed out by arenas (in bytes) */
+static size_t const ARENA_BLOCK_SIZE = 1 << 20;
+
+/* Memory limit for held rules in sweep mode unless -m is given (in bytes) */
+static size_t const SWEEP_RULE_BYTES = 64 << 20;
+
+/* Number of transactions sampled to estimate FP tree compression */
+static int const AUTO_SAMPLE_ROWS = 10000;
+
+/* Smallest average fraction of frequent items per transaction for which the eclat engine is chosen */
+static double const AUTO_ECLAT_MIN_DENSITY = 0.01;
+
+/* Largest size of item bitsets for which the eclat engine is chosen (in bytes) */
+static size_t const AUTO_ECLAT_MAX_BYTES = (size_t) 512 << 20;
+
+/* Smallest number of sample tree nodes per item occurrence in the sample for
+ * which the compact engine is chosen (1 means no prefix is shared) */
+static double const AUTO_COMPACT_MIN_RATIO = 0.5;
+
+/* Largest number of frequent items for which the compact engine is chosen (its
+ * conditional trees keep per-item arrays) */
+static int const AUTO_COMPACT_MAX_ITEMS = 4096;
+
+/* Version of binary transaction cache files */
+static int const CACHE_VERSION = 2;
+
+/* Smallest piece of an input file parsed by one thread (in bytes) */
+static size_t const LOAD_CHUNK_MIN_SIZE = 1 << 20;
+
+/* Estimated memory needed per item of a partition in partitioned mode: parsed
+ * and relabeled item, FP tree node and conditional tree nodes (in bytes) */
+static size_t const SON_BYTES_PER_ITEM = 160;
+
+/* Number of children at which an FP tree node starts indexing its children by
+ * item instead of searching its sibling list */
+static int const CHILD_INDEX_MIN_CHILDREN = 16;
+
+/* Largest number of frequent items of a conditional database mined with
+ * bitmasks instead of a conditional tree (bits in a mask) */
+static int const BITMAP_MAX_ITEMS = 64;
+
+/* Largest number of unfinished work-stealing tasks per worker. Each task holds
+ * its conditional tree, so this bounds the trees built ahead of mining. */
+static int const WS_MAX_PENDING_PER_WORKER = 4;
+
 
 /******************************************
  * Structs
 ******************************************/
 
+/*
+ * @brief A block of memory owned by an arena
+ */
+typedef struct fpt_arena_block {
+  /** Next block in arena */
+  struct fpt_arena_block * next;
+
+  /** Number of usable bytes in block */
+  size_t size;
+
+  /** Number of bytes already handed out from block */
+  size_t used;
+
+  /** Memory handed out by block */
+  char data[];
+} fpt_arena_block;
+
+/*
+ * @brief A region allocator for FP tree nodes. All memory handed out by an
+ *        arena is released at once when the arena is reset.
+ */
+typedef struct
+{
+  /** First block of arena */
+  fpt_arena_block * head;
+
+  /** Block currently handing out memory */
+  fpt_arena_block * current;
+
+  /** Nodes released for reuse before the arena is reset (linked by next_sibling) */
+  struct fpt_node * free_nodes;
+
+  /** Total number of nodes allocated from arena */
+  long nodes_allocated;
+
+  /** Total number of bytes allocated from arena */
+  long bytes_allocated;
+
+  /** Number of bytes held in blocks */
+  size_t bytes_reserved;
+} fpt_arena;
+
+/*
+ * @brief An open-addressing hash table of the children of an FP tree node,
+ *        keyed by item
+ */
+typedef struct
+{
+  /** Number of slots (power of two) */
+  int capacity;
+
+  /** Children hashed by item with linear probing, NULL for empty slots */
+  struct fpt_node * slots[];
+} fpt_child_index;
+
 /*
  * @brief A structure for a node of an FP tree
  */
@@ -32,6 +153,9 @@ typedef struct fpt_node {
   /** Array of item pointers (only used by root) */
   struct fpt_node ** item_array;
 
+  /** Counts of pairs of items in tree, NULL if not built (only used by root) */
+  int * fp_array;
+
   /** Pointer to parent of node */
   struct fpt_node * parent;
 
@@ -48,6 +172,9 @@ typedef struct fpt_node {
   /** Pointer to root of tree */
   struct fpt_node * root;
 
+  /** Children indexed by item, NULL while node has few children */
+  fpt_child_index * child_index;
+
   /** ID of item stored at node */
   int item;
 
@@ -56,8 +183,123 @@ typedef struct fpt_node {
 
   /** The largest unique item ID */
   int max_item_ID;
+
+  /** Number of children of node */
+  int num_children;
 } fpt_node;
 
+/*
+ * @brief A conditional database with few enough items that each prefix path
+ *        fits in one 64-bit mask. Bit b of a mask stands for items[b], and
+ *        items are in ascending order.
+ */
+typedef struct
+{
+  /** Item represented by each bit */
+  int items[64];
+
+  /** Number of bits in use */
+  int num_items;
+
+  /** Bits of required items (see fpt_constraints) */
+  uint64_t required;
+
+  /** Number of prefix paths */
+  int num_paths;
+
+  /** Items of each prefix path */
+  uint64_t * masks;
+
+  /** Number of transactions following each prefix path */
+  int * counts;
+} fpt_bitmap_db;
+
+/*
+ * @brief Constraints on the itemsets found by FP-growth, checked during the
+ *        recursion so branches that cannot satisfy them are never built
+ */
+typedef struct
+{
+  /** Largest number of items in an itemset (0 for no limit) */
+  int max_len;
+
+  /** Whether each item is required, indexed by item ID - 1; itemsets must hold
+   *  at least one required item. NULL if no item is required. */
+  char * required;
+} fpt_constraints;
+
+/*
+ * @brief An FP tree stored as parallel arrays of 32-bit indices. Nodes are
+ *        grouped by item, so the node-links of an item form a contiguous
+ *        range and a parent always has a smaller index than its children.
+ */
+typedef struct
+{
+  /** Number of nodes in tree (root is implicit) */
+  int num_nodes;
+
+  /** Number of nodes arrays have space for */
+  int node_capacity;
+
+  /** The largest unique item ID */
+  int max_item_ID;
+
+  /** Number of items item arrays have space for */
+  int item_capacity;
+
+  /** Item stored at each node */
+  int * item;
+
+  /** Number of transactions containing pattern at each node */
+  int * count;
+
+  /** Index of parent of each node (-1 for children of root) */
+  int * parent;
+
+  /** Scratch space for projecting tree (-1 when unused) */
+  int * map;
+
+  /** Node-links: nodes with item i are item_start[i-1] to item_start[i]-1 */
+  int * item_start;
+
+  /** Support of each item in tree */
+  int * item_supp;
+
+  /** Scratch space for filling item ranges */
+  int * item_cursor;
+} fpt_ctree;
+
+/*
+ * @brief Mining engines that can be selected from the command line
+ */
+typedef enum
+{
+  FPT_ENGINE_FPTREE,
+  FPT_ENGINE_COMPACT,
+  FPT_ENGINE_ECLAT,
+  FPT_ENGINE_AUTO
+} fpt_engine;
+
+/*
+ * @brief Which frequent itemsets are reported
+ */
+typedef enum
+{
+  FPT_MODE_ALL,
+  FPT_MODE_CLOSED,
+  FPT_MODE_MAXIMAL
+} fpt_mode;
+
+/*
+ * @brief Transaction file loaders that can be selected from the command line
+ */
+typedef enum
+{
+  FPT_LOADER_STDIO,
+  FPT_LOADER_MMAP
+} fpt_loader;
+
+
 /*
  * @brief A CSR matrix
  */
@@ -135,6 +377,164 @@ typedef struct
   int max_val;
 } fpt_dyn_csr;
 
+/*
+ * @brief Start of a binary transaction cache file. It is followed by the
+ *        absolute path of the text file (zero padded to a multiple of 8 bytes),
+ *        row_idx (nrows+1 ints), val (nnz ints) and then item counts, forward
+ *        map and backward map (max_val ints each).
+ */
+typedef struct
+{
+  /** Identifies file as a cache ("FPTC") */
+  char magic[4];
+  /** Format version */
+  int version;
+
+  /** The number of transactions */
+  int nrows;
+  /** The number of total items in all transactions */
+  int nnz;
+  /** The largest item ID */
+  int max_val;
+  /** Length of path of text file the cache was built from */
+  int path_len;
+
+  /** Size of text file the cache was built from */
+  long source_size;
+  /** Modification time of text file the cache was built from */
+  long source_mtime;
+} fpt_cache_header;
+
+/*
+ * @brief Transactions loaded from a mapped cache file. The CSR arrays point
+ *        into the mapping.
+ */
+typedef struct
+{
+  /** Mapped file */
+  void * data;
+  /** Size of mapping */
+  size_t size;
+
+  /** Transactions */
+  fpt_dyn_csr csr;
+  fpt_dyn_array val;
+  fpt_dyn_array row_idx;
+
+  /** Count of each item (in terms of original IDs) */
+  int * item_counts;
+  /** Map from original item IDs to IDs sorted by frequency */
+  int * forward_map;
+  /** Map from sorted item IDs to original IDs */
+  int * backward_map;
+} fpt_cache;
+
+/*
+ * @brief An open-addressing hash table mapping itemsets to their position in
+ *        a set of frequent itemsets
+ */
+typedef struct
+{
+  /** Number of slots (a power of two) */
+  int num_slots;
+
+  /** Index of itemset held in each slot (-1 if empty) */
+  int * slots;
+
+  /** Hash of itemset held in each slot */
+  unsigned int * hashes;
+} fpt_itemset_index;
+
+/*
+ * @brief Lists of stored itemsets containing each item, used to find
+ *        supersets of an itemset
+ */
+typedef struct
+{
+  /** Number of items */
+  int num_items;
+
+  /** Indices of itemsets containing each item */
+  fpt_dyn_array ** lists;
+} fpt_superset_index;
+
+/*
+ * @brief Frequent itemsets stored as a suffix trie in the order FP-growth
+ *        finds them. Node i is itemset i: its item followed by the items of its
+ *        ancestors, so an itemset costs one node rather than a copy of its
+ *        suffix. Supports stay in the flat supports array.
+ */
+typedef struct
+{
+  /** Number of nodes (one per itemset); also the index of the implicit root */
+  int num_nodes;
+
+  /** Length of longest itemset */
+  int max_len;
+
+  /** Smallest item of itemset of each node */
+  int * item;
+
+  /** Parent of each node (num_nodes for single items) */
+  int * parent;
+
+  /** Children of node n are children[child_start[n]] to children[child_start[n+1]-1] */
+  int * child_start;
+
+  /** Children of each node in descending item order */
+  int * children;
+} fpt_itemset_trie;
+
+/*
+ * @brief Equivalence class of the vertical (Eclat) engine: the items that
+ *        extend the current suffix, with the bitset of transactions containing
+ *        suffix and item. Bitsets are padded to a multiple of 8 words and
+ *        aligned to 64 bytes.
+ */
+typedef struct
+{
+  /** Number of members */
+  int num_members;
+  /** Number of members space is allocated for */
+  int capacity;
+
+  /** Item of each member (ascending order) */
+  int * items;
+  /** Support of suffix plus each item */
+  int * supps;
+  /** Bitset of each member, one after the other */
+  uint64_t * sets;
+} fpt_eclat_class;
+
+/*
+ * @brief Bounded min-heap of the largest supports found in top-k mode
+ */
+typedef struct
+{
+  /** Number of itemsets wanted */
+  int k;
+  /** Minimum length of itemsets counted towards k */
+  int min_len;
+
+  /** Supports of best itemsets so far (heap[0] is smallest) */
+  int * heap;
+  /** Number of supports in heap */
+  int heap_size;
+
+  /** Current support threshold */
+  int min_freq;
+} fpt_topk;
+
+/*
+ * @brief An itemset held elsewhere, used for sorting
+ */
+typedef struct
+{
+  int * items;
+  int len;
+  int supp;
+} fpt_itemset_ref;
+
 /*
  * @brief A set of dynamic arrays to hold frequent itemsets
  */
@@ -148,8 +548,60 @@ typedef struct
 
   /* Dynamic array for holding counts of frequent itemsets */
   fpt_dyn_array * supports;
+
+  /* Hash index over itemsets for support lookups (NULL if not built) */
+  fpt_itemset_index * index;
+
+  /* Superset lists when only closed or maximal itemsets are held (NULL otherwise) */
+  fpt_superset_index * supersets;
+
+  /* Suffix trie replacing itemsets and itemset_ind once built (NULL otherwise) */
+  fpt_itemset_trie * trie;
 } fpt_freq_itemsets;
 
+/*
+ * @brief A sliding window over the most recent transactions, kept in a
+ *        CanTree: an FP tree whose items are inserted in ascending ID order
+ *        rather than by frequency, so the tree stays valid as frequencies
+ *        drift and transactions can be added and expired in place
+ */
+typedef struct
+{
+  /** Root of window tree */
+  fpt_node * tree;
+
+  /** Arena holding window tree; expired nodes are reused from it */
+  fpt_arena * arena;
+
+  /** Maximum number of transactions in window */
+  int capacity;
+
+  /** Number of transactions in window */
+  int num_trans;
+
+  /** Slot of oldest transaction */
+  int oldest;
+
+  /** Length of each transaction in window, by slot (grows up to capacity slots) */
+  int * lens;
+
+  /** Number of slots allocated for lens */
+  int lens_capacity;
+
+  /** Ring buffer of items of transactions in window (ascending order within
+   *  each transaction, oldest transaction first) */
+  int * items;
+
+  /** Size of items (power of two) */
+  long items_capacity;
+
+  /** Position of first item of oldest transaction (taken modulo items_capacity) */
+  long head;
+
+  /** Position one past last item of newest transaction (taken modulo items_capacity) */
+  long tail;
+} fpt_window;
+
 /*
  * @brief A set of dynamic arrays to hold generated rules
  */
@@ -174,108 +626,339 @@ typedef struct
   fpt_dyn_array_dbl * conf;
 } fpt_rules;
 
-/*****************************************
- * Code
-*****************************************/
-
-/**
- * * @brief Return the number of seconds since an unspecified time (e.g., Unix
- * *        epoch). This is accomplished with a high-resolution monotonic timer,
- * *        suitable for performance timing.
- * *
- * * @return The number of seconds.
- * */
-static inline double monotonic_seconds()
-{
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return ts.tv_sec + ts.tv_nsec * 1e-9;
-}
-
 /*
- * @brief Comparison operator for sorting item IDs based on frequency
- *
- * @param a Pointer to first fpt_item_freq
- * @param b Pointer to second fpt_item_freq
+ * @brief Number of candidate consequents of each length seen during rule
+ *        generation (index k holds consequents of k items)
  */
-int fpt_item_pair_comp(
-    const void *a,
-    const void *b)
+typedef struct
 {
-  fpt_item_freq * a_freq = (fpt_item_freq *) a;
-  fpt_item_freq * b_freq = (fpt_item_freq *) b;
+  /** Number of consequent lengths with space in arrays */
+  int num_levels;
 
-  return (b_freq->count - a_freq->count);
-}
+  /** Candidates joined from consequents one item shorter */
+  long * generated;
+
+  /** Candidates with a subset consequent that was not confident */
+  long * pruned;
+
+  /** Candidates that gave a rule */
+  long * accepted;
+} fpt_rule_stats;
 
 /*
- * @brief Standard comparison operator for ascending order with qsort
- *
- * @param a Pointer to first int
- * @param b Pointer to second int
- *
- * return Value signifying order
+ * @brief Scratch space for generating the rules of itemsets, reused across
+ *        itemsets and consequent lengths so rule generation does not allocate
  */
-int fpt_lt(
-    const void *a,
-    const void *b)
+typedef struct
 {
-  int * a_ptr = (int *) a;
-  int * b_ptr = (int *) b;
+  /** Candidate consequents of current length */
+  fpt_dyn_array * cand_rules;
 
-  return *a_ptr - *b_ptr;
-}
+  /** Whether each candidate survived pruning */
+  int * marker;
+  int marker_capacity;
+
+  /** LHS of rule being checked, or subset of candidate being looked up */
+  int * lhs;
+  int lhs_capacity;
+
+  /** Hash table of consequents at previous length (index of consequent, -1 if empty) */
+  int * slots;
+  int slots_capacity;
+
+  /** Candidates at each consequent length */
+  fpt_rule_stats stats;
+} fpt_rule_work;
 
 /*
- * @brief Initialize dynamic array
- *
- * @return Allocated dynamic array
+ * @brief A stealable unit of work: mining one conditional tree
  */
-fpt_dyn_array * fpt_dyn_array_malloc()
-{
-  fpt_dyn_array * arr = malloc(sizeof(*arr));
+typedef struct fpt_task {
+  /** Conditional tree to mine */
+  fpt_node * tree;
 
-  arr->capacity = DYN_ARRAY_INIT_CAPACITY;
-  arr->num_elements = 0;
+  /** Arena holding tree (NULL if tree is not owned by task) */
+  fpt_arena * arena;
 
-  arr->array = malloc(DYN_ARRAY_INIT_CAPACITY * sizeof(*arr->array));
+  /** Suffix the conditional tree was built for */
+  int * suffix;
 
-  return arr;
-}
+  /** Length of suffix */
+  int suff_len;
+
+  /** Frequent itemsets found by task */
+  fpt_freq_itemsets * freq_itemsets;
+
+  /** Tasks spawned while mining tree */
+  struct fpt_task ** children;
+
+  /** Number of itemsets task had found when each child was spawned */
+  int * splice_pos;
+
+  /** Number of children spawned */
+  int num_children;
+
+  /** Space allocated for children */
+  int children_capacity;
+} fpt_task;
 
 /*
- * @brief Initialize dynamic array
- *
- * @return Allocated dynamic array
+ * @brief A double-ended queue of tasks. The owning worker works at the bottom,
+ *        thieves take from the top.
  */
-fpt_dyn_array_dbl * fpt_dyn_array_dbl_malloc()
+typedef struct
 {
-  fpt_dyn_array_dbl * arr = malloc(sizeof(*arr));
+  /** Array of tasks */
+  fpt_task ** tasks;
 
-  arr->capacity = DYN_ARRAY_INIT_CAPACITY;
-  arr->num_elements = 0;
+  /** Index of oldest task */
+  int top;
 
-  arr->array = malloc(DYN_ARRAY_INIT_CAPACITY * sizeof(*arr->array));
+  /** One past index of newest task */
+  int bottom;
 
-  return arr;
-}
+  /** Space allocated for tasks */
+  int capacity;
+
+  /** Lock protecting queue */
+  omp_lock_t lock;
+} fpt_deque;
 
 /*
- * @brief Double size of dynamic array
- *
- * @param arr Dynamic array
+ * @brief State of a worker in the work-stealing scheduler
  */
-void fpt_dyn_array_double(
-    fpt_dyn_array * arr)
+typedef struct
 {
-  arr->array = (int *) realloc(arr->array, 2 * arr->capacity * sizeof(*arr->array));
-  arr->capacity = 2 * arr->capacity;
-}
+  /** Arenas for each level of recursion */
+  fpt_arena ** arenas;
 
-/*
- * @brief Double size of dynamic array
- *
- * @param arr Dynamic array
+  /** Suffix buffer (points one past last element) */
+  int * suffix;
+
+  /** Arenas of finished tasks kept for reuse */
+  fpt_arena ** spare_arenas;
+
+  /** Number of spare arenas */
+  int num_spare_arenas;
+
+  /** Space allocated for spare arenas */
+  int spare_capacity;
+
+  /** Number of tasks run */
+  long tasks_run;
+
+  /** Number of tasks stolen from other workers */
+  long steals;
+
+  /** Time spent looking for work */
+  double idle_time;
+} fpt_worker;
+
+/*
+ * @brief Shared state of the work-stealing scheduler
+ */
+typedef struct
+{
+  /** Number of workers */
+  int num_workers;
+
+  /** Queue of each worker */
+  fpt_deque * deques;
+
+  /** State of each worker */
+  fpt_worker * workers;
+
+  /** Number of tasks created but not finished */
+  long pending;
+
+  /** Minimum frequency for frequent pattern */
+  int min_freq;
+
+  /** Conditional trees with at least this many prefix paths become tasks */
+  int task_threshold;
+
+  /** Largest number of tasks created but not finished */
+  long max_pending;
+} fpt_scheduler;
+
+/*
+ * @brief An engine's way of mining the itemsets of one suffix item, used to
+ *        spread suffix items over threads and ranks
+ */
+typedef struct
+{
+  /** Shared state of engine, only read while mining */
+  void * data;
+
+  /** Allocate scratch space of a thread */
+  void * (*scratch_init)(void * data);
+
+  /** Find the itemsets whose largest item is item (none if item is absent) */
+  void (*mine)(void * data, void * scratch, int item, int * suffix, fpt_freq_itemsets * freq_itemsets);
+
+  /** Free scratch space of a thread */
+  void (*scratch_free)(void * data, void * scratch);
+} fpt_suffix_miner;
+
+/*
+ * @brief Shared state of FP tree engine for fpt_suffix_miner
+ */
+typedef struct
+{
+  /** Pointer to root of FP tree */
+  fpt_node * tree;
+
+  /** Minimum frequency for frequent pattern */
+  int min_freq;
+
+  /** Constraints on itemsets (NULL for none) */
+  const fpt_constraints * cons;
+
+  /** Arenas that allocation statistics of all threads are added to */
+  fpt_arena ** arenas;
+} fpt_tree_miner;
+
+/*
+ * @brief Shared state of compact FP tree engine for fpt_suffix_miner
+ */
+typedef struct
+{
+  /** Compact FP tree */
+  fpt_ctree * tree;
+
+  /** Minimum frequency for frequent pattern */
+  int min_freq;
+} fpt_ctree_miner;
+
+/*
+ * @brief Scratch space of a thread of the compact FP tree engine
+ */
+typedef struct
+{
+  /** Compact FP trees reused for each level of recursion */
+  fpt_ctree ** levels;
+
+  /** Map from nodes of tree to nodes of conditional tree (-1 if none) */
+  int * map;
+} fpt_ctree_scratch;
+
+/*
+ * @brief Shared state of vertical engine for fpt_suffix_miner
+ */
+typedef struct
+{
+  /** Class of all items */
+  fpt_eclat_class * cls;
+
+  /** Number of 64-bit words in each bitset */
+  int words;
+
+  /** Minimum frequency for frequent pattern */
+  int min_freq;
+} fpt_eclat_miner;
+
+/*****************************************
+ * Code
+*****************************************/
+
+/**
+ * * @brief Return the number of seconds since an unspecified time (e.g., Unix
+ * *        epoch). This is accomplished with a high-resolution monotonic timer,
+ * *        suitable for performance timing.
+ * *
+ * * @return The number of seconds.
+ * */
+static inline double monotonic_seconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * @brief Comparison operator for sorting item IDs based on frequency
+ *
+ * @param a Pointer to first fpt_item_freq
+ * @param b Pointer to second fpt_item_freq
+ */
+int fpt_item_pair_comp(
+    const void *a,
+    const void *b)
+{
+  fpt_item_freq * a_freq = (fpt_item_freq *) a;
+  fpt_item_freq * b_freq = (fpt_item_freq *) b;
+
+  return (b_freq->count - a_freq->count);
+}
+
+/*
+ * @brief Standard comparison operator for ascending order with qsort
+ *
+ * @param a Pointer to first int
+ * @param b Pointer to second int
+ *
+ * return Value signifying order
+ */
+int fpt_lt(
+    const void *a,
+    const void *b)
+{
+  int * a_ptr = (int *) a;
+  int * b_ptr = (int *) b;
+
+  return *a_ptr - *b_ptr;
+}
+
+/*
+ * @brief Initialize dynamic array
+ *
+ * @return Allocated dynamic array
+ */
+fpt_dyn_array * fpt_dyn_array_malloc()
+{
+  fpt_dyn_array * arr = malloc(sizeof(*arr));
+
+  arr->capacity = DYN_ARRAY_INIT_CAPACITY;
+  arr->num_elements = 0;
+
+  arr->array = malloc(DYN_ARRAY_INIT_CAPACITY * sizeof(*arr->array));
+
+  return arr;
+}
+
+/*
+ * @brief Initialize dynamic array
+ *
+ * @return Allocated dynamic array
+ */
+fpt_dyn_array_dbl * fpt_dyn_array_dbl_malloc()
+{
+  fpt_dyn_array_dbl * arr = malloc(sizeof(*arr));
+
+  arr->capacity = DYN_ARRAY_INIT_CAPACITY;
+  arr->num_elements = 0;
+
+  arr->array = malloc(DYN_ARRAY_INIT_CAPACITY * sizeof(*arr->array));
+
+  return arr;
+}
+
+/*
+ * @brief Double size of dynamic array
+ *
+ * @param arr Dynamic array
+ */
+void fpt_dyn_array_double(
+    fpt_dyn_array * arr)
+{
+  arr->array = (int *) realloc(arr->array, 2 * arr->capacity * sizeof(*arr->array));
+  arr->capacity = 2 * arr->capacity;
+}
+
+/*
+ * @brief Double size of dynamic array
+ *
+ * @param arr Dynamic array
  */
 void fpt_dyn_array_dbl_double(
     fpt_dyn_array_dbl * arr)
@@ -408,6 +1091,9 @@ fpt_freq_itemsets * fpt_freq_itemsets_init()
   freq_itemsets->itemsets = fpt_dyn_array_malloc();
   freq_itemsets->itemset_ind = fpt_dyn_array_malloc();
   freq_itemsets->supports = fpt_dyn_array_malloc();
+  freq_itemsets->index = NULL;
+  freq_itemsets->supersets = NULL;
+  freq_itemsets->trie = NULL;
 
   fpt_dyn_array_add(freq_itemsets->itemset_ind, 0);
 
@@ -422,12 +1108,90 @@ fpt_freq_itemsets * fpt_freq_itemsets_init()
 void fpt_freq_itemsets_free(
     fpt_freq_itemsets * freq_itemsets)
 {
-  fpt_dyn_array_free(freq_itemsets->itemsets);
-  fpt_dyn_array_free(freq_itemsets->itemset_ind);
+  if (freq_itemsets->trie != NULL) {
+    free(freq_itemsets->trie->item);
+    free(freq_itemsets->trie->parent);
+    free(freq_itemsets->trie->child_start);
+    free(freq_itemsets->trie->children);
+    free(freq_itemsets->trie);
+  }
+  else {
+    fpt_dyn_array_free(freq_itemsets->itemsets);
+    fpt_dyn_array_free(freq_itemsets->itemset_ind);
+  }
   fpt_dyn_array_free(freq_itemsets->supports);
+  if (freq_itemsets->index != NULL) {
+    free(freq_itemsets->index->slots);
+    free(freq_itemsets->index->hashes);
+    free(freq_itemsets->index);
+  }
+  if (freq_itemsets->supersets != NULL) {
+    for (int i=0; i<freq_itemsets->supersets->num_items; i++) {
+      fpt_dyn_array_free(freq_itemsets->supersets->lists[i]);
+    }
+    free(freq_itemsets->supersets->lists);
+    free(freq_itemsets->supersets);
+  }
   free(freq_itemsets);
 }
 
+/*
+ * @brief Exchange the itemsets held by two sets (indexes are not exchanged)
+ *
+ * @param a First set of frequent itemsets
+ * @param b Second set of frequent itemsets
+ */
+void fpt_freq_itemsets_swap(
+    fpt_freq_itemsets * a,
+    fpt_freq_itemsets * b)
+{
+  fpt_dyn_array * tmp;
+
+  tmp = a->itemsets; a->itemsets = b->itemsets; b->itemsets = tmp;
+  tmp = a->itemset_ind; a->itemset_ind = b->itemset_ind; b->itemset_ind = tmp;
+  tmp = a->supports; a->supports = b->supports; b->supports = tmp;
+}
+
+/*
+ * @brief Add an itemset to set of frequent itemsets
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ * @param itemset Array holding itemset
+ * @param itemset_len Length of itemset
+ * @param supp Support count of itemset
+ */
+void fpt_freq_itemsets_add(
+    fpt_freq_itemsets * freq_itemsets,
+    int * itemset,
+    int itemset_len,
+    int supp)
+{
+  fpt_dyn_array_add(freq_itemsets->supports, supp);
+
+  fpt_dyn_array_add_values(freq_itemsets->itemsets, itemset, itemset_len);
+  fpt_dyn_array_add(freq_itemsets->itemset_ind, freq_itemsets->itemset_ind->array[freq_itemsets->itemset_ind->num_elements-1] + itemset_len);
+}
+
+/*
+ * @brief Append a range of itemsets from one set of frequent itemsets to another
+ *
+ * @param dest Set of frequent itemsets to append to
+ * @param src Set of frequent itemsets to copy from
+ * @param first Index of first itemset to copy
+ * @param last One past index of last itemset to copy
+ */
+void fpt_freq_itemsets_append(
+    fpt_freq_itemsets * dest,
+    fpt_freq_itemsets * src,
+    int first,
+    int last)
+{
+  for (int i=first; i<last; i++) {
+    int start = src->itemset_ind->array[i];
+    fpt_freq_itemsets_add(dest, &src->itemsets->array[start], src->itemset_ind->array[i+1] - start, src->supports->array[i]);
+  }
+}
+
 /*
  * @brief Initialize rules
  *
@@ -468,15 +1232,125 @@ void fpt_rules_free(
 }
 
 /*
- * @brief Look up support of frequent itemset
+ * @brief Hash an itemset
+ *
+ * @param itemset Array holding itemset
+ * @param itemset_len Length of itemset
+ *
+ * @return Hash of itemset
+ */
+static inline unsigned int fpt_hash_itemset(
+    const int * itemset,
+    int itemset_len)
+{
+  unsigned int hash = 2166136261u;
+
+  for (int i=0; i<itemset_len; i++) {
+    hash = (hash ^ (unsigned int) itemset[i]) * 16777619u;
+  }
+
+  /* Mix high bits into low bits used for slot selection */
+  hash ^= hash >> 15;
+  hash *= 0x2c1b3c6du;
+  hash ^= hash >> 12;
+
+  return hash;
+}
+
+/*
+ * @brief Build hash index over a set of frequent itemsets
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ */
+void fpt_itemset_index_build(
+    fpt_freq_itemsets * freq_itemsets)
+{
+  int num_itemsets = freq_itemsets->supports->num_elements;
+
+  fpt_itemset_index * index = malloc(sizeof(*index));
+
+  /* Keep load factor at or below one half */
+  index->num_slots = 2;
+  while (index->num_slots < 2 * num_itemsets) {
+    index->num_slots *= 2;
+  }
+  index->slots = malloc(index->num_slots * sizeof(*index->slots));
+  index->hashes = malloc(index->num_slots * sizeof(*index->hashes));
+  for (int i=0; i<index->num_slots; i++) {
+    index->slots[i] = -1;
+  }
+
+  unsigned int mask = index->num_slots - 1;
+  for (int i=0; i<num_itemsets; i++) {
+    int start = freq_itemsets->itemset_ind->array[i];
+    unsigned int hash = fpt_hash_itemset(&freq_itemsets->itemsets->array[start], freq_itemsets->itemset_ind->array[i+1] - start);
+
+    unsigned int slot = hash & mask;
+    while (index->slots[slot] != -1) {
+      slot = (slot + 1) & mask;
+    }
+    index->slots[slot] = i;
+    index->hashes[slot] = hash;
+  }
+
+  freq_itemsets->index = index;
+}
+
+/*
+ * @brief Number of bytes used by hash index of itemsets
+ *
+ * @param index Hash index
+ *
+ * @return Bytes held by index
+ */
+size_t fpt_itemset_index_bytes(
+    fpt_itemset_index * index)
+{
+  return sizeof(*index) + (size_t) index->num_slots * (sizeof(*index->slots) + sizeof(*index->hashes));
+}
+
+/*
+ * @brief Look up support of itemset in hash index
+ *
+ * @param itemset Array holding itemset
+ * @param itemset_len Length of itemset
+ * @param freq_itemsets Set of frequent itemsets with index built
+ *
+ * @return Support count of itemset, or -1 if not found
+ */
+int fpt_index_lookup_support(
+    const int * itemset,
+    int itemset_len,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_itemset_index * index = freq_itemsets->index;
+  unsigned int hash = fpt_hash_itemset(itemset, itemset_len);
+  unsigned int mask = index->num_slots - 1;
+
+  for (unsigned int slot = hash & mask; index->slots[slot] != -1; slot = (slot + 1) & mask) {
+    if (index->hashes[slot] == hash) {
+      int i = index->slots[slot];
+      int start = freq_itemsets->itemset_ind->array[i];
+      if (freq_itemsets->itemset_ind->array[i+1] - start == itemset_len &&
+          memcmp(&freq_itemsets->itemsets->array[start], itemset, itemset_len * sizeof(*itemset)) == 0) {
+        return freq_itemsets->supports->array[i];
+      }
+    }
+  }
+
+  return -1;
+}
+
+/*
+ * @brief Look up support of frequent itemset by binary search
  *
  * @param itemset Array holding itemset
  * @param itemset_len Length of itemset
  * @param freq_itemsets Set of frequent itemsets
  *
- * @return Support count of itemset
+ * @return Support count of itemset, or -1 if not found
  */
-int fpt_lookup_support(
+int fpt_search_support(
     int * itemset,
     int itemset_len,
     fpt_freq_itemsets * freq_itemsets)
@@ -521,24 +1395,412 @@ int fpt_lookup_support(
     }
   }
 
-  printf("Itemset not found:");
-  for (int i=0; i<itemset_len; i++) {
-    printf("%d ", itemset[i]);
-  }
-  printf("\n");
   return -1;
 }
 
 /*
- * @brief Compute LHS of rule given itemset and RHS
+ * @brief Append a range of rules from one set of rules to another
  *
- * @param itemset
- * @param itemset_len
- * @param rhs
- * @param rhs_len
- * @param lhs Variable to store left-hand side of rule
+ * @param dest Set of rules to append to
+ * @param src Set of rules to copy from
+ * @param first Index of first rule to copy
+ * @param last One past index of last rule to copy
  */
-void fpt_rule_lhs(
+void fpt_rules_append(
+    fpt_rules * dest,
+    fpt_rules * src,
+    int first,
+    int last)
+{
+  for (int i=first; i<last; i++) {
+    int lhs_start = src->lhs_idx->array[i];
+    int lhs_len = src->lhs_idx->array[i+1] - lhs_start;
+    fpt_dyn_array_add_values(dest->lhs, &src->lhs->array[lhs_start], lhs_len);
+    fpt_dyn_array_add(dest->lhs_idx, dest->lhs_idx->array[dest->lhs_idx->num_elements-1] + lhs_len);
+
+    int rhs_start = src->rhs_idx->array[i];
+    int rhs_len = src->rhs_idx->array[i+1] - rhs_start;
+    fpt_dyn_array_add_values(dest->rhs, &src->rhs->array[rhs_start], rhs_len);
+    fpt_dyn_array_add(dest->rhs_idx, dest->rhs_idx->array[dest->rhs_idx->num_elements-1] + rhs_len);
+
+    fpt_dyn_array_add(dest->supp, src->supp->array[i]);
+    fpt_dyn_array_dbl_add(dest->conf, src->conf->array[i]);
+  }
+}
+
+/*
+ * @brief Build lists of the itemsets containing each item, so supports of
+ *        itemsets that are not held can be derived from their supersets
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ * @param num_items Number of items
+ */
+void fpt_superset_index_build(
+    fpt_freq_itemsets * freq_itemsets,
+    int num_items)
+{
+  fpt_superset_index * supersets = malloc(sizeof(*supersets));
+
+  supersets->num_items = num_items;
+  supersets->lists = malloc(num_items * sizeof(*supersets->lists));
+  for (int i=0; i<num_items; i++) {
+    supersets->lists[i] = fpt_dyn_array_malloc();
+  }
+
+  for (int k=0; k<freq_itemsets->supports->num_elements; k++) {
+    for (int j=freq_itemsets->itemset_ind->array[k]; j<freq_itemsets->itemset_ind->array[k+1]; j++) {
+      fpt_dyn_array_add(supersets->lists[freq_itemsets->itemsets->array[j]-1], k);
+    }
+  }
+
+  freq_itemsets->supersets = supersets;
+}
+
+/*
+ * @brief Find largest support of a stored superset of an itemset. Only the
+ *        list of the item with fewest stored itemsets is scanned.
+ *
+ * @param freq_itemsets Set of frequent itemsets with superset lists
+ * @param itemset Array holding itemset (ascending order)
+ * @param itemset_len Length of itemset
+ *
+ * @return Largest support of a superset, or -1 if there is none
+ */
+int fpt_superset_support(
+    fpt_freq_itemsets * freq_itemsets,
+    int * itemset,
+    int itemset_len)
+{
+  fpt_dyn_array ** lists = freq_itemsets->supersets->lists;
+
+  fpt_dyn_array * list = lists[itemset[0]-1];
+  for (int i=1; i<itemset_len; i++) {
+    if (lists[itemset[i]-1]->num_elements < list->num_elements) {
+      list = lists[itemset[i]-1];
+    }
+  }
+
+  int max_supp = -1;
+
+  for (int k=0; k<list->num_elements; k++) {
+    int ind = list->array[k];
+    int supp = freq_itemsets->supports->array[ind];
+    if (supp <= max_supp) {
+      continue;
+    }
+
+    /* Both itemsets are in ascending order */
+    int * cand = &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[ind]];
+    int cand_len = freq_itemsets->itemset_ind->array[ind+1] - freq_itemsets->itemset_ind->array[ind];
+    int i = 0;
+    for (int j=0; j<cand_len && i<itemset_len && cand_len-j >= itemset_len-i; j++) {
+      if (cand[j] == itemset[i]) {
+        i++;
+      }
+      else if (cand[j] > itemset[i]) {
+        break;
+      }
+    }
+
+    if (i == itemset_len) {
+      max_supp = supp;
+    }
+  }
+
+  return max_supp;
+}
+
+/*
+ * @brief Replace the flat itemsets of a set by a suffix trie. Each itemset
+ *        extends the latest itemset found one item shorter, which holds for
+ *        every set in the order FP-growth finds itemsets.
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ *
+ * @return 0 on success, -1 if itemsets are not in FP-growth order (set is left flat)
+ */
+int fpt_itemset_trie_build(
+    fpt_freq_itemsets * freq_itemsets)
+{
+  int num_itemsets = freq_itemsets->supports->num_elements;
+  int * itemset_ind = freq_itemsets->itemset_ind->array;
+
+  fpt_itemset_trie * trie = malloc(sizeof(*trie));
+  trie->num_nodes = num_itemsets;
+  trie->max_len = 0;
+  for (int i=0; i<num_itemsets; i++) {
+    if (itemset_ind[i+1] - itemset_ind[i] > trie->max_len) {
+      trie->max_len = itemset_ind[i+1] - itemset_ind[i];
+    }
+  }
+
+  trie->item = malloc(num_itemsets * sizeof(*trie->item));
+  trie->parent = malloc(num_itemsets * sizeof(*trie->parent));
+  trie->child_start = calloc(num_itemsets+2, sizeof(*trie->child_start));
+  trie->children = malloc(num_itemsets * sizeof(*trie->children));
+
+  /* Latest node of each itemset length */
+  int * latest = malloc((trie->max_len+1) * sizeof(*latest));
+  int * cursor = malloc((num_itemsets+1) * sizeof(*cursor));
+
+  int ordered = 1;
+  int depth = 0;
+  for (int i=0; i<num_itemsets && ordered; i++) {
+    int * itemset = &freq_itemsets->itemsets->array[itemset_ind[i]];
+    int len = itemset_ind[i+1] - itemset_ind[i];
+
+    if (len < 1 || len > depth+1) {
+      ordered = 0;
+      break;
+    }
+
+    int parent = (len > 1) ? latest[len-2] : num_itemsets;
+    for (int k=1, p=parent; k<len; k++, p=trie->parent[p]) {
+      if (trie->item[p] != itemset[k]) {
+        ordered = 0;
+      }
+    }
+
+    trie->item[i] = itemset[0];
+    trie->parent[i] = parent;
+    trie->child_start[parent+1]++;
+    latest[len-1] = i;
+    depth = len;
+  }
+
+  if (ordered) {
+    for (int n=0; n<=num_itemsets; n++) {
+      trie->child_start[n+1] += trie->child_start[n];
+      cursor[n] = trie->child_start[n];
+    }
+
+    /* Children are added in the order found, which must be descending */
+    for (int i=0; i<num_itemsets && ordered; i++) {
+      int parent = trie->parent[i];
+      if (cursor[parent] > trie->child_start[parent] && trie->item[trie->children[cursor[parent]-1]] <= trie->item[i]) {
+        ordered = 0;
+      }
+      trie->children[cursor[parent]++] = i;
+    }
+  }
+
+  free(latest);
+  free(cursor);
+
+  if (!ordered) {
+    free(trie->item);
+    free(trie->parent);
+    free(trie->child_start);
+    free(trie->children);
+    free(trie);
+    return -1;
+  }
+
+  fpt_dyn_array_free(freq_itemsets->itemsets);
+  fpt_dyn_array_free(freq_itemsets->itemset_ind);
+  freq_itemsets->itemsets = NULL;
+  freq_itemsets->itemset_ind = NULL;
+  freq_itemsets->trie = trie;
+
+  return 0;
+}
+
+/*
+ * @brief Number of bytes used by the itemsets of a set and their supports
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ *
+ * @return Bytes held in flat arrays or in trie
+ */
+size_t fpt_freq_itemsets_bytes(
+    fpt_freq_itemsets * freq_itemsets)
+{
+  size_t num_itemsets = freq_itemsets->supports->num_elements;
+
+  if (freq_itemsets->trie != NULL) {
+    return sizeof(*freq_itemsets->trie) + (4 * num_itemsets + 2) * sizeof(int) + num_itemsets * sizeof(*freq_itemsets->supports->array);
+  }
+
+  return (freq_itemsets->itemsets->num_elements + freq_itemsets->itemset_ind->num_elements + num_itemsets) * sizeof(int);
+}
+
+/*
+ * @brief Look up support of itemset in suffix trie, from its largest item down
+ *
+ * @param itemset Array holding itemset
+ * @param itemset_len Length of itemset
+ * @param freq_itemsets Set of frequent itemsets held in trie
+ *
+ * @return Support count of itemset, or -1 if not found
+ */
+int fpt_trie_lookup_support(
+    const int * itemset,
+    int itemset_len,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_itemset_trie * trie = freq_itemsets->trie;
+  int node = trie->num_nodes;
+
+  for (int k=itemset_len-1; k>=0; k--) {
+    int left = trie->child_start[node];
+    int right = trie->child_start[node+1] - 1;
+    int child = -1;
+
+    while (left <= right) {
+      int mid = left + (right-left)/2;
+      int item = trie->item[trie->children[mid]];
+      if (item == itemset[k]) {
+        child = trie->children[mid];
+        break;
+      }
+      else if (item > itemset[k]) {
+        left = mid+1;
+      }
+      else {
+        right = mid-1;
+      }
+    }
+
+    if (child == -1) {
+      return -1;
+    }
+    node = child;
+  }
+
+  return (node < trie->num_nodes) ? freq_itemsets->supports->array[node] : -1;
+}
+
+/*
+ * @brief Get an itemset from a set of frequent itemsets, whether it is held
+ *        flat or in a trie
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ * @param i Index of itemset
+ * @param buf Space for itemset if it must be rebuilt from trie (trie->max_len items)
+ * @param itemset_len Length of itemset (output)
+ *
+ * @return itemset Items of itemset in ascending order
+ */
+static inline int * fpt_freq_itemsets_get(
+    fpt_freq_itemsets * freq_itemsets,
+    int i,
+    int * buf,
+    int * itemset_len)
+{
+  fpt_itemset_trie * trie = freq_itemsets->trie;
+
+  if (trie == NULL) {
+    *itemset_len = freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i];
+    return &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[i]];
+  }
+
+  int len = 0;
+  for (int node = i; node != trie->num_nodes; node = trie->parent[node]) {
+    buf[len++] = trie->item[node];
+  }
+  *itemset_len = len;
+
+  return buf;
+}
+
+/*
+ * @brief Look up support of frequent itemset
+ *
+ * @param itemset Array holding itemset
+ * @param itemset_len Length of itemset
+ * @param freq_itemsets Set of frequent itemsets
+ *
+ * @return Support count of itemset
+ */
+int fpt_lookup_support(
+    int * itemset,
+    int itemset_len,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  int supp;
+
+  if (freq_itemsets->trie != NULL) {
+    supp = fpt_trie_lookup_support(itemset, itemset_len, freq_itemsets);
+  }
+  else if (freq_itemsets->index != NULL) {
+    supp = fpt_index_lookup_support(itemset, itemset_len, freq_itemsets);
+  }
+  else {
+    supp = fpt_search_support(itemset, itemset_len, freq_itemsets);
+  }
+
+  /* Itemsets that are not closed get the support of their closure */
+  if (supp == -1 && freq_itemsets->supersets != NULL) {
+    supp = fpt_superset_support(freq_itemsets, itemset, itemset_len);
+  }
+
+  if (supp == -1) {
+    printf("Itemset not found:");
+    for (int i=0; i<itemset_len; i++) {
+      printf("%d ", itemset[i]);
+    }
+    printf("\n");
+  }
+
+  return supp;
+}
+
+/*
+ * @brief Build hash index over frequent itemsets. When verbose, also report
+ *        build time, size and lookup throughput against binary search.
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ * @param verbose Benchmark and cross-check the index
+ */
+void fpt_build_support_index(
+    fpt_freq_itemsets * freq_itemsets,
+    int verbose)
+{
+  int num_itemsets = freq_itemsets->supports->num_elements;
+
+  double start = monotonic_seconds();
+  fpt_itemset_index_build(freq_itemsets);
+  double build_time = monotonic_seconds() - start;
+
+  if (!verbose) {
+    return;
+  }
+
+  /* Look up every itemset once with each method */
+  long checksum = 0;
+  start = monotonic_seconds();
+  for (int i=0; i<num_itemsets; i++) {
+    int first = freq_itemsets->itemset_ind->array[i];
+    checksum += fpt_index_lookup_support(&freq_itemsets->itemsets->array[first], freq_itemsets->itemset_ind->array[i+1] - first, freq_itemsets);
+  }
+  double index_time = monotonic_seconds() - start;
+
+  start = monotonic_seconds();
+  for (int i=0; i<num_itemsets; i++) {
+    int first = freq_itemsets->itemset_ind->array[i];
+    checksum -= fpt_search_support(&freq_itemsets->itemsets->array[first], freq_itemsets->itemset_ind->array[i+1] - first, freq_itemsets);
+  }
+  double search_time = monotonic_seconds() - start;
+
+  if (checksum != 0) {
+    printf("Support index disagrees with binary search\n");
+  }
+
+  printf("Support index: %0.04f seconds to build, %zu bytes\n", build_time, fpt_itemset_index_bytes(freq_itemsets->index));
+  printf("Support lookups: %0.2f million/s with index, %0.2f million/s with binary search\n",
+      num_itemsets / (index_time > 0 ? index_time : 1e-9) * 1e-6, num_itemsets / (search_time > 0 ? search_time : 1e-9) * 1e-6);
+}
+
+/*
+ * @brief Compute LHS of rule given itemset and RHS
+ *
+ * @param itemset
+ * @param itemset_len
+ * @param rhs
+ * @param rhs_len
+ * @param lhs Variable to store left-hand side of rule
+ */
+void fpt_rule_lhs(
     int * itemset,
     int itemset_len,
     int * rhs,
@@ -591,12 +1853,7 @@ void fpt_sort_item_IDs(
   /* Create maps between new and old item IDs */
   for (int i=0; i<max_item_ID; i++) {
     backward_map[i] = item_pairs[i].item;
-
-    int j = 0;
-    while (item_pairs[j].item != i+1) {
-      j += 1;
-    }
-    forward_map[i] = j+1;
+    forward_map[item_pairs[i].item - 1] = i+1;
   }
 
   free(item_pairs);
@@ -702,156 +1959,448 @@ void fpt_free_csr(
 }
 
 /*
- * @brief Creates a new node with NULL pointers
+ * @brief Comparison operator putting transactions in lexicographic order, so
+ *        transactions sharing a prefix are next to each other
+ *
+ * @param a Pointer to first fpt_itemset_ref
+ * @param b Pointer to second fpt_itemset_ref
  */
-fpt_node * fpt_new_node()
+int fpt_trans_comp(
+    const void * a,
+    const void * b)
 {
-  fpt_node * node = malloc(sizeof(*node));
-
-  node->child = NULL;
-  node->item_array = NULL;
-  node->parent = NULL;
-  node->ngbr = NULL;
-  node->prev_sibling = NULL;
-  node->next_sibling = NULL;
-  node->root = NULL;
+  const fpt_itemset_ref * x = a;
+  const fpt_itemset_ref * y = b;
 
-  node->item = 0;
-  node->count = 0;
+  for (int t=0; t<x->len && t<y->len; t++) {
+    if (x->items[t] != y->items[t]) {
+      return (x->items[t] < y->items[t]) ? -1 : 1;
+    }
+  }
 
-  return node;
+  return x->len - y->len;
 }
 
 /*
- * @brief Add a child node to an existing node in the FP tree
- *
- * @param parent Pointer to parent node
- * @param item Item stored at node
+ * @brief Sort the rows of a CSR matrix lexicographically, so consecutive
+ *        insertions into an FP tree share prefixes. Each thread sorts a run of
+ *        rows, then neighbouring runs are merged in parallel.
  *
- * @return child Pointer to new child node
+ * @param trans Transactions (items of each row in ascending order)
  */
-fpt_node * fpt_add_child_node(
-    fpt_node * parent,
-    int item)
+void fpt_sort_transactions(
+    fpt_csr * trans)
 {
-  fpt_node * new_node = fpt_new_node();
+  int nrows = trans->nrows;
+  fpt_itemset_ref * refs = malloc(nrows * sizeof(*refs));
+  fpt_itemset_ref * merged = malloc(nrows * sizeof(*merged));
+
+  for (int i=0; i<nrows; i++) {
+    refs[i].items = &trans->val[trans->row_idx[i]];
+    refs[i].len = trans->row_idx[i+1] - trans->row_idx[i];
+    refs[i].supp = 1;
+  }
 
-  new_node->item = item;
-  new_node->parent = parent;
-  new_node->root = parent->root;
+  int num_runs = omp_get_max_threads();
+  int * bounds = malloc((num_runs+1) * sizeof(*bounds));
+  for (int r=0; r<=num_runs; r++) {
+    bounds[r] = (long) nrows * r / num_runs;
+  }
 
-  /* Add new node to beginning of parent's child list */
-  new_node->next_sibling = parent->child;
-  new_node->prev_sibling = NULL;
+  #pragma omp parallel for schedule(static, 1)
+  for (int r=0; r<num_runs; r++) {
+    qsort(refs + bounds[r], bounds[r+1] - bounds[r], sizeof(*refs), fpt_trans_comp);
+  }
 
-  if (new_node->next_sibling != NULL) {
-    new_node->next_sibling->prev_sibling = new_node;    /* Make new node previous sibling of next sibling */
+  for (int width=1; width<num_runs; width*=2) {
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (int r=0; r<num_runs; r+=2*width) {
+      int lo = bounds[r];
+      int mid = bounds[(r+width < num_runs) ? r+width : num_runs];
+      int hi = bounds[(r+2*width < num_runs) ? r+2*width : num_runs];
+
+      /* A run without a neighbour is copied as is */
+      int i = lo;
+      int j = mid;
+      for (int k=lo; k<hi; k++) {
+        if (j >= hi || (i < mid && fpt_trans_comp(&refs[i], &refs[j]) <= 0)) {
+          merged[k] = refs[i++];
+        }
+        else {
+          merged[k] = refs[j++];
+        }
+      }
+    }
+
+    fpt_itemset_ref * tmp = refs;
+    refs = merged;
+    merged = tmp;
   }
 
-  parent->child = new_node;
+  int * val = malloc(trans->nnz * sizeof(*val));
+  int pos = 0;
+  for (int i=0; i<nrows; i++) {
+    memcpy(val + pos, refs[i].items, refs[i].len * sizeof(*val));
+    trans->row_idx[i] = pos;
+    pos += refs[i].len;
+  }
+  trans->row_idx[nrows] = pos;
 
-  return new_node;
+  free(trans->val);
+  trans->val = val;
+
+  free(refs);
+  free(merged);
+  free(bounds);
 }
 
 /*
- * @brief Add a new node that is the parent of an existing node
- *
- * @param child Pointer to child node
- * @param item Item stored at node
+ * @brief Initialize an empty arena
  *
- * @return parent Pointer to new parent node
+ * @return Allocated arena
  */
-fpt_node * fpt_add_parent_node(
-    fpt_node * child,
-    int item)
+fpt_arena * fpt_arena_init()
 {
-  fpt_node * new_node = fpt_new_node();
+  fpt_arena * arena = malloc(sizeof(*arena));
 
-  new_node->item = item;
-  new_node->child = child;
-  new_node->root = child->root;
-
-  child->parent = new_node;
+  arena->head = NULL;
+  arena->current = NULL;
+  arena->free_nodes = NULL;
+  arena->nodes_allocated = 0;
+  arena->bytes_allocated = 0;
+  arena->bytes_reserved = 0;
 
-  return new_node;
+  return arena;
 }
 
 /*
- * @brief Delete node from FP tree
+ * @brief Allocate memory from an arena
+ *
+ * @param arena Arena to allocate from
+ * @param size Number of bytes to allocate
  *
- * @param node Node to delete
+ * @return Pointer to allocated memory
  */
-void fpt_delete_node(
-    fpt_node * node)
+void * fpt_arena_alloc(
+    fpt_arena * arena,
+    size_t size)
 {
+  /* Keep everything aligned for pointers */
+  size = (size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
 
-  /* Do not need to change item pointers because algorithm removes all nodes with a given item, not individual nodes */
-
-  if (node == node->root) {
-    free(node->item_array);
-    free(node);
-    return;
-  }
-
-  if (node->prev_sibling != NULL) {      /* Node has a previous sibling */
-    node->prev_sibling->next_sibling = node->next_sibling;
-  }
-  else {          /* Node is first child of parent */
-    node->parent->child = node->next_sibling;
-  }
+  fpt_arena_block * block = arena->current;
 
-  if (node->next_sibling != NULL) {      /* Node has a next sibling */
-    node->next_sibling->prev_sibling = node->prev_sibling;
-  }
+  while (block == NULL || block->used + size > block->size) {
+    if (block != NULL && block->next != NULL) {     /* Reuse blocks left over from before last reset */
+      block = block->next;
+      block->used = 0;
+      continue;
+    }
 
-  /* Add node's children to parent's list of children */
-  fpt_node * current = node->child;
+    size_t block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    fpt_arena_block * new_block = malloc(sizeof(*new_block) + block_size);
+    new_block->next = NULL;
+    new_block->size = block_size;
+    new_block->used = 0;
+    arena->bytes_reserved += block_size;
 
-  if (current != NULL) {    /* Node has children */
-    while (current->next_sibling != NULL) {
-      current->parent = node->parent;
-      current = current->next_sibling;
+    if (block == NULL) {
+      arena->head = new_block;
     }
-    current->parent = node->parent;
-
-    /* Add children to beginning of parent's child list */
-    current->next_sibling = node->parent->child;
-    if(current->next_sibling != NULL) {
-      current->next_sibling->prev_sibling = current;
+    else {
+      block->next = new_block;
     }
-    current->parent->child = node->child;
+    block = new_block;
   }
 
-  /* Free memory */
-  if (node->item_array != NULL) {
-    free(node->item_array);
-  }
-  free(node);
+  arena->current = block;
+  arena->bytes_allocated += size;
+
+  void * ptr = block->data + block->used;
+  block->used += size;
 
+  return ptr;
 }
 
 /*
- * @brief Delete a tree starting at the root
+ * @brief Allocate zeroed memory for an array from an arena
  *
- * @param tree Pointer to root of tree
+ * @param arena Arena to allocate from
+ * @param num Number of elements
+ * @param size Size of each element
+ *
+ * @return Pointer to allocated memory
  */
-void fpt_delete_tree(
-    fpt_node * tree)
+void * fpt_arena_calloc(
+    fpt_arena * arena,
+    size_t num,
+    size_t size)
 {
-  fpt_node * current = tree->next_sibling;
+  void * ptr = fpt_arena_alloc(arena, num * size);
+  memset(ptr, 0, num * size);
 
-  if(current != NULL) {
-    fpt_delete_tree(current);
-  }
+  return ptr;
+}
+
+/*
+ * @brief Release everything allocated from an arena. Blocks are kept for reuse.
+ *
+ * @param arena Arena to reset
+ */
+void fpt_arena_reset(
+    fpt_arena * arena)
+{
+  arena->current = arena->head;
+  arena->free_nodes = NULL;
+  if (arena->head != NULL) {
+    arena->head->used = 0;
+  }
+}
+
+/*
+ * @brief Free arena and all of its blocks
+ *
+ * @param arena Arena to free
+ */
+void fpt_arena_free(
+    fpt_arena * arena)
+{
+  fpt_arena_block * block = arena->head;
+
+  while (block != NULL) {
+    fpt_arena_block * next = block->next;
+    free(block);
+    block = next;
+  }
+
+  free(arena);
+}
+
+/*
+ * @brief Creates a new node with NULL pointers
+ *
+ * @param arena Arena to allocate node from (released nodes are reused first)
+ */
+fpt_node * fpt_new_node(
+    fpt_arena * arena)
+{
+  fpt_node * node;
+  if (arena->free_nodes != NULL) {
+    node = arena->free_nodes;
+    arena->free_nodes = node->next_sibling;
+  }
+  else {
+    node = fpt_arena_alloc(arena, sizeof(*node));
+    arena->nodes_allocated++;
+    node->child_index = NULL;
+  }
+
+  node->child = NULL;
+  node->item_array = NULL;
+  node->fp_array = NULL;
+  node->parent = NULL;
+  node->ngbr = NULL;
+  node->prev_sibling = NULL;
+  node->next_sibling = NULL;
+  node->root = NULL;
+
+  /* A reused node keeps the memory of its child index */
+  if (node->child_index != NULL) {
+    memset(node->child_index->slots, 0, node->child_index->capacity * sizeof(*node->child_index->slots));
+  }
+
+  node->item = 0;
+  node->count = 0;
+  node->num_children = 0;
+
+  return node;
+}
+
+/*
+ * @brief Add a child to the child index of its parent
+ *
+ * @param index Child index of parent (has a free slot)
+ * @param child Child to add
+ */
+void fpt_child_index_put(
+    fpt_child_index * index,
+    fpt_node * child)
+{
+  int mask = index->capacity - 1;
+  int slot = child->item & mask;
+
+  while (index->slots[slot] != NULL) {
+    slot = (slot + 1) & mask;
+  }
+  index->slots[slot] = child;
+}
+
+/*
+ * @brief Remove a child from the child index of its parent. Later children of
+ *        the same probe sequence are shifted back, so no tombstones are needed.
+ *
+ * @param index Child index of parent
+ * @param child Child to remove
+ */
+void fpt_child_index_remove(
+    fpt_child_index * index,
+    fpt_node * child)
+{
+  int mask = index->capacity - 1;
+  int slot = child->item & mask;
+
+  while (index->slots[slot] != child) {
+    slot = (slot + 1) & mask;
+  }
+
+  int hole = slot;
+  for (slot = (slot + 1) & mask; index->slots[slot] != NULL; slot = (slot + 1) & mask) {
+    int home = index->slots[slot]->item & mask;
+
+    /* Move entry into hole unless its home lies cyclically in (hole, slot] */
+    if (((slot - home) & mask) >= ((slot - hole) & mask)) {
+      index->slots[hole] = index->slots[slot];
+      index->slots[slot] = NULL;
+      hole = slot;
+    }
+  }
+  index->slots[hole] = NULL;
+}
+
+/*
+ * @brief Index the children of a node, reusing the node's current index when
+ *        it is large enough
+ *
+ * @param node Node whose children are indexed
+ * @param arena Arena to allocate index from
+ */
+void fpt_build_child_index(
+    fpt_node * node,
+    fpt_arena * arena)
+{
+  int capacity = 4;
+  while (capacity < 4 * node->num_children) {
+    capacity *= 2;
+  }
+
+  fpt_child_index * index = node->child_index;
+  if (index == NULL || index->capacity < capacity) {
+    index = fpt_arena_alloc(arena, sizeof(*index) + capacity * sizeof(*index->slots));
+    index->capacity = capacity;
+  }
+  memset(index->slots, 0, index->capacity * sizeof(*index->slots));
+
+  for (fpt_node * child = node->child; child != NULL; child = child->next_sibling) {
+    fpt_child_index_put(index, child);
+  }
+  node->child_index = index;
+}
+
+/*
+ * @brief Find the child of a node holding an item
+ *
+ * @param node Parent node
+ * @param item Item to find
+ *
+ * @return child Pointer to child, NULL if there is no child with item
+ */
+fpt_node * fpt_find_child(
+    fpt_node * node,
+    int item)
+{
+  fpt_child_index * index = node->child_index;
+
+  if (index == NULL) {
+    fpt_node * child = node->child;
+    while (child != NULL && child->item != item) {
+      child = child->next_sibling;
+    }
+    return child;
+  }
+
+  int mask = index->capacity - 1;
+  for (int slot = item & mask; index->slots[slot] != NULL; slot = (slot + 1) & mask) {
+    if (index->slots[slot]->item == item) {
+      return index->slots[slot];
+    }
+  }
+  return NULL;
+}
+
+/*
+ * @brief Add a child node to an existing node in the FP tree
+ *
+ * @param parent Pointer to parent node
+ * @param item Item stored at node
+ * @param arena Arena to allocate node from
+ *
+ * @return child Pointer to new child node
+ */
+fpt_node * fpt_add_child_node(
+    fpt_node * parent,
+    int item,
+    fpt_arena * arena)
+{
+  fpt_node * new_node = fpt_new_node(arena);
+
+  new_node->item = item;
+  new_node->parent = parent;
+  new_node->root = parent->root;
+
+  /* Add new node to beginning of parent's child list */
+  new_node->next_sibling = parent->child;
+  new_node->prev_sibling = NULL;
+
+  if (new_node->next_sibling != NULL) {
+    new_node->next_sibling->prev_sibling = new_node;    /* Make new node previous sibling of next sibling */
+  }
 
-  current = tree->child;
+  parent->child = new_node;
+
+  /* Switch high fan-out nodes to indexed lookup, growing index at half load */
+  parent->num_children++;
+  if (parent->child_index != NULL && 2 * parent->num_children <= parent->child_index->capacity) {
+    fpt_child_index_put(parent->child_index, new_node);
+  }
+  else if (parent->num_children >= CHILD_INDEX_MIN_CHILDREN) {
+    fpt_build_child_index(parent, arena);
+  }
 
-  if(current != NULL) {
-    fpt_delete_tree(current);
+  return new_node;
+}
+
+/*
+ * @brief Unlink a node from its parent and hand the node and all of its
+ *        descendants back to their arena for reuse
+ *
+ * @param node Root of subtree to release
+ * @param arena Arena the subtree was allocated from
+ */
+void fpt_release_subtree(
+    fpt_node * node,
+    fpt_arena * arena)
+{
+  if (node->prev_sibling != NULL) {
+    node->prev_sibling->next_sibling = node->next_sibling;
+  }
+  else {
+    node->parent->child = node->next_sibling;
+  }
+  if (node->next_sibling != NULL) {
+    node->next_sibling->prev_sibling = node->prev_sibling;
+  }
+  if (node->parent->child_index != NULL) {
+    fpt_child_index_remove(node->parent->child_index, node);
   }
+  node->parent->num_children--;
 
-  fpt_delete_node(tree);
+  /* Children are released depth first, each unlinking itself from node */
+  while (node->child != NULL) {
+    fpt_release_subtree(node->child, arena);
+  }
 
+  node->next_sibling = arena->free_nodes;
+  arena->free_nodes = node;
 }
 
 /*
@@ -896,26 +2445,6 @@ void fpt_create_item_pointers(
   }
 }
 
-/*
- * @brief Propagate counts from leaves up to root
- *
- * @param tree Pointer to root of FP tree
- * @param item Index of item at leaves
- */
-void fpt_propagate_counts_up(
-    fpt_node * tree,
-    int item)
-{
-  for (int i=item; i>0; i--) {
-    fpt_node * current = tree->item_array[i-1];
-
-    while(current != NULL) {
-      current->parent->count += current->count;
-      current = current->ngbr;     /* Move through item pointers */
-    }
-  }
-}
-
 /*
  * @brief Travel item pointers to count specific item in tree
  *
@@ -938,555 +2467,5885 @@ int fpt_count_item(
 }
 
 /*
- * @brief Construct FP tree
+ * @brief Allocate an FP-array for a tree. The array starts with the rank of
+ *        each item among the items in the tree (-1 if absent), followed by a
+ *        lower-triangular matrix of pair counts indexed by rank.
  *
- * @param trans CSR array of transactions
+ * @param arena Arena to allocate FP-array from
+ * @param max_item_ID Largest item ID in tree
+ * @param counts Support of each item (NULL if every item is in tree)
+ * @param min_freq Minimum support for item to be in tree
  *
- * @return tree Pointer to root node of FP tree
+ * @return FP-array, or NULL if tree has too many items for one
  */
-fpt_node * fpt_create_fp_tree(
-    fpt_csr * trans)
+int * fpt_fp_array_init(
+    fpt_arena * arena,
+    int max_item_ID,
+    const int * counts,
+    int min_freq)
 {
-  fpt_node * root = fpt_new_node();
-  root->item_array = malloc(trans->max_val * sizeof(*root->item_array));
-  for (int i=0; i<trans->max_val; i++) {
-    root->item_array[i] = NULL;
+  long num_items = 0;
+  for (int i=0; i<max_item_ID; i++) {
+    if (counts == NULL || counts[i] >= min_freq) {
+      num_items++;
+    }
   }
-  root->root = root;
-  root->max_item_ID = trans->max_val;
-
-  fpt_node * current_node;
-  fpt_node * child;
 
-  /* Add each transaction */
-  for( int i=0; i<trans->nrows; i++ ) {
-    current_node = root;
+  long num_pairs = num_items * (num_items-1) / 2;
+  if (num_pairs > FP_ARRAY_MAX_PAIRS || num_items < 2) {
+    return NULL;
+  }
 
-    /* Add each item from current transaction */
-    for( int j = trans->row_idx[i]; j<trans->row_idx[i+1]; j++ ) {
-      child = current_node->child;
+  int * fp_array = fpt_arena_alloc(arena, (max_item_ID + num_pairs) * sizeof(*fp_array));
 
-      /* Search for existing path with same item */
-      while (child != NULL) {
-        if (child->item == trans->val[j]) {
-          break;
-        }
-        child = child->next_sibling;
-      }
+  int rank = 0;
+  for (int i=0; i<max_item_ID; i++) {
+    fp_array[i] = (counts == NULL || counts[i] >= min_freq) ? rank++ : -1;
+  }
+  memset(&fp_array[max_item_ID], 0, num_pairs * sizeof(*fp_array));
 
-      if (child == NULL) {                /* No path with current item found */
-        child = fpt_add_child_node( current_node, trans->val[j] );
-        child->count = 1;
-        if (child->item == child->parent->item) {
-          printf("Child and parent have same item\n");
-        }
-      }
-      else {                              /* Path with matching item found */
-        child->count += 1;
-      }
+  return fp_array;
+}
 
-      current_node = child;               /* Prepare to add next item */
+/*
+ * @brief Add counts of every pair of items in a path to FP-array of tree
+ *
+ * @param tree Pointer to root of tree
+ * @param path Items of path in ascending order
+ * @param len Number of items in path
+ * @param count Number of transactions following path
+ */
+void fpt_fp_array_add_path(
+    fpt_node * tree,
+    const int * path,
+    int len,
+    int count)
+{
+  int * ranks = tree->fp_array;
+  int * pairs = &tree->fp_array[tree->max_item_ID];
+
+  for (int b=1; b<len; b++) {
+    int rank_b = ranks[path[b]-1];
+    int * row = &pairs[(long) rank_b * (rank_b-1) / 2];
+    for (int a=0; a<b; a++) {
+      row[ranks[path[a]-1]] += count;
     }
   }
-
-  fpt_create_item_pointers(root);
-
-  return root;
-
 }
 
 /*
- * @brief Create tree of prefix paths on a given item
- *
- * @param tree Pointer to root of tree to build prefix paths from
- * @param item Item prefix paths will be built on
+ * @brief Insert a path into a tree, merging with existing prefixes
  *
- * @return prefix_tree Pointer to root of tree of prefix paths
+ * @param tree Pointer to root of tree
+ * @param path Items of path in ascending order
+ * @param len Number of items in path
+ * @param count Number of transactions following path
+ * @param arena Arena to allocate new nodes from
  */
-fpt_node * fpt_create_prefix_tree(
+void fpt_insert_path(
     fpt_node * tree,
-    int item)
+    const int * path,
+    int len,
+    int count,
+    fpt_arena * arena)
 {
-  fpt_node * node_to_copy;
+  fpt_node * current_node = tree;
+  fpt_node * child;
 
-  fpt_node * prefix_tree = fpt_new_node();
-  prefix_tree->item_array = calloc(item, sizeof(*prefix_tree->item_array));
+  /* Add each item from path */
+  for (int j=0; j<len; j++) {
+    /* Search for existing path with same item */
+    child = fpt_find_child(current_node, path[j]);
 
-  prefix_tree->root = prefix_tree;
-  prefix_tree->max_item_ID = item;
+    if (child == NULL) {                  /* No path with current item found */
+      child = fpt_add_child_node( current_node, path[j], arena );
+      if (child->item == child->parent->item) {
+        printf("Child and parent have same item\n");
+      }
+    }
+    child->count += count;
 
-  /* Array of pointers to current node with each item. Will use to prevent copying nodes multiple times */
-  fpt_node ** current_nodes_orig = calloc((item-1), sizeof(*current_nodes_orig) );
-  /* Array of pointers to current node in prefix_tree */
-  fpt_node ** current_nodes_pref = calloc(item, sizeof(*current_nodes_pref) );
+    current_node = child;                 /* Prepare to add next item */
+  }
+}
 
-  node_to_copy = tree->item_array[item-1];
+/*
+ * @brief Construct FP tree
+ *
+ * @param trans CSR array of transactions
+ * @param arena Arena to allocate tree from
+ *
+ * @return tree Pointer to root node of FP tree
+ */
+fpt_node * fpt_create_fp_tree(
+    fpt_csr * trans,
+    fpt_arena * arena)
+{
+  fpt_node * root = fpt_new_node(arena);
+  root->item_array = fpt_arena_calloc(arena, trans->max_val, sizeof(*root->item_array));
+  root->root = root;
+  root->max_item_ID = trans->max_val;
+  root->fp_array = fpt_fp_array_init(arena, trans->max_val, NULL, 0);
 
-  fpt_node * new_node;
+  /* Add each transaction */
+  for( int i=0; i<trans->nrows; i++ ) {
+    int * items = &trans->val[trans->row_idx[i]];
+    int len = trans->row_idx[i+1] - trans->row_idx[i];
 
-  /* Walk along list of desired item */
-  while( node_to_copy != NULL ) {
-    /* Initialize new leaf node and add to tree */
-    new_node = fpt_new_node();
-    new_node->root = prefix_tree;
-    new_node->count = node_to_copy->count;
-    new_node->item = item;
-    new_node->ngbr = prefix_tree->item_array[item-1];
-    prefix_tree->item_array[item-1] = new_node;
+    fpt_insert_path(root, items, len, 1, arena);
+    if (root->fp_array != NULL) {
+      fpt_fp_array_add_path(root, items, len, 1);
+    }
+  }
 
-    fpt_node * parent_orig = node_to_copy->parent;
-    int add_to_root = 1;    /* Boolean to tell if path already led to root. If so, don't add redundant nodes as children of root */
-    /* Walk up tree and add parents */
-    /* This process relies on the fact that the list of pointers is ordered across all items
-     * to ensure no node is duplicated multiple times. This is done by walking up paths from
-     * leaves to the root while checking item pointers to see if a node in the original tree
-     * has already been visited. */
-    while(parent_orig != tree->root) {
-      int parent_item = parent_orig->item-1;       /* Subtract 1 to give index into arrays */
-      if(parent_orig != current_nodes_orig[parent_item]) {    /* Node has not been seen in original tree */
-        new_node = fpt_add_parent_node(new_node, parent_item+1);  /* Add new parent node */
+  fpt_create_item_pointers(root);
 
-        /* Store original node and new node in array for if we reach the same node in our tree later */
-        current_nodes_pref[parent_item] = new_node;
-        current_nodes_orig[parent_item] = parent_orig;
+  return root;
 
-        /* Update pointers between items */
-        new_node->ngbr = prefix_tree->item_array[parent_item];
-        prefix_tree->item_array[parent_item] = new_node;
-      }
-      else {    /* Parent has already been seen in original */
-        /* Add new node to child list of parent */
-        new_node->next_sibling = current_nodes_pref[parent_item]->child;
-        current_nodes_pref[parent_item]->child->prev_sibling = new_node;
-        current_nodes_pref[parent_item]->child = new_node;
-        new_node->parent = current_nodes_pref[parent_item];
+}
 
-        add_to_root = 0;
-        break;    /* Once an old path is reached, move to next leaf */
+/*
+ * @brief Count the support of each item within the prefix paths of an item,
+ *        reading the FP-array of the tree when it has one
+ *
+ * @param tree Pointer to root of FP tree
+ * @param item ID of item to project on
+ * @param arena Arena to allocate counts from
+ *
+ * @return counts Support of each item smaller than item
+ */
+int * fpt_prefix_counts(
+    fpt_node * tree,
+    int item,
+    fpt_arena * arena)
+{
+  int * counts = fpt_arena_calloc(arena, item, sizeof(*counts));
+
+  if (tree->fp_array != NULL) {
+    int rank = tree->fp_array[item-1];
+    int * row = &tree->fp_array[tree->max_item_ID + (long) rank * (rank-1) / 2];
+    for (int i=0; i<item-1; i++) {
+      if (tree->fp_array[i] >= 0) {
+        counts[i] = row[tree->fp_array[i]];
       }
-
-      parent_orig = parent_orig->parent;
     }
-
-    if(add_to_root) {
-      /* Add top node as child of root */
-      new_node->parent = prefix_tree;
-      new_node->next_sibling = prefix_tree->child;
-      if(prefix_tree->child != NULL) {
-        prefix_tree->child->prev_sibling = new_node;
+  }
+  else {
+    for (fpt_node * node = tree->item_array[item-1]; node != NULL; node = node->ngbr) {
+      for (fpt_node * parent = node->parent; parent != tree; parent = parent->parent) {
+        counts[parent->item-1] += node->count;
       }
-      prefix_tree->child = new_node;
     }
-
-    node_to_copy = node_to_copy->ngbr;  /* Move to next node with desired item */
   }
 
-  fpt_propagate_counts_up(prefix_tree, item);
-
-  free(current_nodes_orig);
-  free(current_nodes_pref);
-
-  return prefix_tree;
-
+  return counts;
 }
 
 /*
- * @brief Create conditional FP tree from prefix paths tree
+ * @brief Build conditional FP tree from prefix paths of an item, copying only
+ *        the items that are frequent within them
  *
  * @param tree Pointer to root of FP tree
  * @param item ID of item to project on
+ * @param counts Support of each item within prefix paths (from fpt_prefix_counts)
  * @param min_freq Minimum frequency for inclusion in conditional tree
+ * @param arena Arena to allocate tree from
  *
  * @return cond_tree Pointer to root of conditional FP tree
  */
-fpt_node * fpt_create_conditional_tree(
+fpt_node * fpt_build_conditional_tree(
     fpt_node * tree,
     int item,
-    int min_freq)
+    const int * counts,
+    int min_freq,
+    fpt_arena * arena)
 {
-
-  int count = 0;
-
-  fpt_node * cond_tree = fpt_create_prefix_tree(tree, item);
+  fpt_node * cond_tree = fpt_new_node(arena);
+  cond_tree->item_array = fpt_arena_calloc(arena, item, sizeof(*cond_tree->item_array));
+  cond_tree->root = cond_tree;
   cond_tree->max_item_ID = item-1;
 
-  for (int i=0; i<cond_tree->max_item_ID; i++) {
-    count = fpt_count_item(cond_tree->item_array[i]);
-    fpt_node * current;
-    fpt_node * next;
+  cond_tree->fp_array = fpt_fp_array_init(arena, cond_tree->max_item_ID, counts, min_freq);
+
+  /* Insert frequent part of each prefix path */
+  int * path = fpt_arena_alloc(arena, item * sizeof(*path));
 
-    if(count < min_freq) {
-      current = cond_tree->item_array[i];
-      while(current != NULL) {
-        next = current->ngbr;
-        fpt_delete_node(current);
-        current = next;
+  for (fpt_node * node = tree->item_array[item-1]; node != NULL; node = node->ngbr) {
+    int start = item;
+    for (fpt_node * parent = node->parent; parent != tree; parent = parent->parent) {
+      if (counts[parent->item-1] >= min_freq) {
+        path[--start] = parent->item;
       }
-      cond_tree->item_array[i] = NULL;
     }
-  }
 
-  /* Remove leaf nodes from tree */
-  fpt_node * current = cond_tree->item_array[cond_tree->max_item_ID];
-  fpt_node * next;
-  while(current != NULL) {
-    next = current->ngbr;
-    fpt_delete_node(current);
-    current = next;
+    fpt_insert_path(cond_tree, &path[start], item-start, node->count, arena);
+    if (cond_tree->fp_array != NULL) {
+      fpt_fp_array_add_path(cond_tree, &path[start], item-start, node->count);
+    }
   }
-  cond_tree->item_array[cond_tree->max_item_ID] = NULL;
+
+  fpt_create_item_pointers(cond_tree);
 
   return cond_tree;
 }
 
 /*
- * @brief Find frequent itemsets
+ * @brief Create conditional FP tree from prefix paths of an item. Supports of
+ *        the items in the prefix paths come from the FP-array of the tree when
+ *        it has one, so only frequent items are ever copied.
  *
  * @param tree Pointer to root of FP tree
- * @param min_freq Minimum frequency for frequent pattern
- * @param suffix Current suffix
- * @param suff_len Current suffix length
- * @param freq_itemsets Container for holding frequent itemsets
+ * @param item ID of item to project on
+ * @param min_freq Minimum frequency for inclusion in conditional tree
+ * @param arena Arena to allocate tree from
+ *
+ * @return cond_tree Pointer to root of conditional FP tree
  */
-void fpt_find_frequent_itemsets(
+fpt_node * fpt_create_conditional_tree(
     fpt_node * tree,
+    int item,
     int min_freq,
-    int * suffix,
-    int suff_len,
-    fpt_freq_itemsets * freq_itemsets)
+    fpt_arena * arena)
 {
-    for (int i=tree->max_item_ID; i>0; i--) {
-      if (tree->item_array[i-1] != NULL) {
-        *(suffix-suff_len-1) = i;
-        suff_len += 1;
+  int * counts = fpt_prefix_counts(tree, item, arena);
 
-        int count = fpt_count_item(tree->item_array[i-1]);
-        fpt_dyn_array_add(freq_itemsets->supports, count);
+  return fpt_build_conditional_tree(tree, item, counts, min_freq, arena);
+}
+
+/*
+ * @brief Check whether a tree consists of a single path
+ *
+ * @param tree Pointer to root of tree
+ *
+ * @return Deepest node of path, or NULL if tree branches
+ */
+fpt_node * fpt_single_path(
+    fpt_node * tree)
+{
+  fpt_node * node = tree;
+
+  while (node->child != NULL) {
+    if (node->child->next_sibling != NULL) {
+      return NULL;
+    }
+    node = node->child;
+  }
+
+  return node;
+}
+
+/*
+ * @brief Check whether an itemset satisfies the required item constraint
+ *
+ * @param cons Constraints (NULL for none)
+ * @param itemset Itemset
+ * @param len Length of itemset
+ *
+ * @return 1 if itemset holds a required item or no item is required, 0 otherwise
+ */
+int fpt_has_required(
+    const fpt_constraints * cons,
+    const int * itemset,
+    int len)
+{
+  if (cons == NULL || cons->required == NULL) {
+    return 1;
+  }
+
+  for (int i=0; i<len; i++) {
+    if (cons->required[itemset[i]-1]) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * @brief Check whether itemsets of a given length may be extended
+ *
+ * @param cons Constraints (NULL for none)
+ * @param len Length of itemset
+ *
+ * @return 1 if longer itemsets are allowed, 0 otherwise
+ */
+static inline int fpt_can_extend(
+    const fpt_constraints * cons,
+    int len)
+{
+  return cons == NULL || cons->max_len == 0 || len < cons->max_len;
+}
+
+/*
+ * @brief Find frequent itemsets of a tree consisting of a single path. Every
+ *        combination of items on the path is frequent and its support is the
+ *        count of its deepest node, so itemsets are listed directly in the
+ *        order the recursive algorithm would find them.
+ *
+ * @param node Deepest node of path that can be added to suffix
+ * @param supp Support of current suffix within path (0 before any path item is added)
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_mine_single_path(
+    fpt_node * node,
+    int supp,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    const fpt_constraints * cons)
+{
+  int found = fpt_has_required(cons, &suffix[-1 * suff_len], suff_len);
+
+  /* Without a required item so far, only nodes up to the topmost required one can complete an itemset */
+  fpt_node * stop = node->root;
+  if (!found) {
+    stop = node;
+    for (fpt_node * n = node; n != n->root; n = n->parent) {
+      if (cons->required[n->item-1]) {
+        stop = n->parent;
+      }
+    }
+  }
+
+  for (; node != stop; node = node->parent) {
+    int count = (supp > 0) ? supp : node->count;
+
+    *(suffix-suff_len-1) = node->item;
+    if (found || cons->required[node->item-1]) {
+      fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, count);
+    }
+
+    if (fpt_can_extend(cons, suff_len+1)) {
+      fpt_mine_single_path(node->parent, count, suffix, suff_len+1, freq_itemsets, cons);
+    }
+  }
+}
+
+/*
+ * @brief Allocate space for the paths of a bitmap database, along with a hash
+ *        table used to merge equal paths while the database is filled
+ *
+ * @param db Database to allocate paths of
+ * @param max_paths Largest number of paths added
+ * @param arena Arena to allocate from
+ *
+ * @return slots Hash table of path indices (-1 for empty slots), with a power
+ *         of two slots at least twice max_paths, preceded by the slot mask
+ */
+int * fpt_bitmap_db_reserve(
+    fpt_bitmap_db * db,
+    int max_paths,
+    fpt_arena * arena)
+{
+  int capacity = 4;
+  while (capacity < 2 * max_paths) {
+    capacity *= 2;
+  }
+
+  db->num_paths = 0;
+  db->masks = fpt_arena_alloc(arena, max_paths * sizeof(*db->masks));
+  db->counts = fpt_arena_alloc(arena, max_paths * sizeof(*db->counts));
+
+  int * slots = fpt_arena_alloc(arena, (capacity+1) * sizeof(*slots));
+  slots[0] = capacity-1;
+  memset(&slots[1], 0xff, capacity * sizeof(*slots));
+
+  return &slots[1];
+}
+
+/*
+ * @brief Add a path to a bitmap database, merging it into an equal path
+ *
+ * @param db Database to add path to
+ * @param slots Hash table from fpt_bitmap_db_reserve
+ * @param mask Items of path
+ * @param count Number of transactions following path
+ */
+static inline void fpt_bitmap_db_add(
+    fpt_bitmap_db * db,
+    int * slots,
+    uint64_t mask,
+    int count)
+{
+  int slot_mask = slots[-1];
+  int slot = (int) ((mask * 0x9E3779B97F4A7C15ULL) >> 32) & slot_mask;
+
+  while (slots[slot] >= 0) {
+    if (db->masks[slots[slot]] == mask) {
+      db->counts[slots[slot]] += count;
+      return;
+    }
+    slot = (slot + 1) & slot_mask;
+  }
+
+  slots[slot] = db->num_paths;
+  db->masks[db->num_paths] = mask;
+  db->counts[db->num_paths] = count;
+  db->num_paths++;
+}
+
+/*
+ * @brief Encode the prefix paths of an item as bitmasks over their frequent
+ *        items, if there are few enough of them
+ *
+ * @param tree Pointer to root of FP tree
+ * @param item ID of item to project on
+ * @param counts Support of each item within prefix paths (from fpt_prefix_counts)
+ * @param min_freq Minimum frequency for inclusion in conditional database
+ * @param supp Support of each frequent item of database (by bit, output)
+ * @param cons Constraints on itemsets (NULL for none)
+ * @param arena Arena to allocate database from
+ *
+ * @return db Conditional database, or NULL if it has more than BITMAP_MAX_ITEMS items
+ */
+fpt_bitmap_db * fpt_create_conditional_bitmaps(
+    fpt_node * tree,
+    int item,
+    const int * counts,
+    int min_freq,
+    int * supp,
+    const fpt_constraints * cons,
+    fpt_arena * arena)
+{
+  /* Bit of each frequent item, -1 for other items */
+  int * bits = fpt_arena_alloc(arena, item * sizeof(*bits));
+
+  int num_items = 0;
+  for (int i=0; i<item-1; i++) {
+    if (counts[i] >= min_freq) {
+      if (num_items == BITMAP_MAX_ITEMS) {
+        return NULL;
+      }
+      supp[num_items++] = counts[i];
+      bits[i] = num_items-1;
+    }
+    else {
+      bits[i] = -1;
+    }
+  }
+
+  fpt_bitmap_db * db = fpt_arena_alloc(arena, sizeof(*db));
+  db->num_items = num_items;
+  db->required = 0;
+  for (int i=0; i<item-1; i++) {
+    if (bits[i] >= 0) {
+      db->items[bits[i]] = i+1;
+      if (cons != NULL && cons->required != NULL && cons->required[i]) {
+        db->required |= (uint64_t) 1 << bits[i];
+      }
+    }
+  }
+
+  int num_paths = 0;
+  for (fpt_node * node = tree->item_array[item-1]; node != NULL; node = node->ngbr) {
+    num_paths++;
+  }
+  int * slots = fpt_bitmap_db_reserve(db, num_paths, arena);
+
+  for (fpt_node * node = tree->item_array[item-1]; node != NULL; node = node->ngbr) {
+    uint64_t mask = 0;
+    for (fpt_node * parent = node->parent; parent != tree; parent = parent->parent) {
+      if (bits[parent->item-1] >= 0) {
+        mask |= (uint64_t) 1 << bits[parent->item-1];
+      }
+    }
+
+    if (mask != 0) {
+      fpt_bitmap_db_add(db, slots, mask, node->count);
+    }
+  }
+
+  return db;
+}
+
+/*
+ * @brief Find frequent itemsets of a conditional database that is a single
+ *        path, in the order fpt_mine_single_path lists them
+ *
+ * @param db Database the path comes from (for its items)
+ * @param mask Items of path
+ * @param supp Support of path
+ * @param found Whether suffix holds a required item
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_bitmap_mine_single_path(
+    const fpt_bitmap_db * db,
+    uint64_t mask,
+    int supp,
+    int found,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    const fpt_constraints * cons)
+{
+  while (mask != 0 && (found || (mask & db->required) != 0)) {
+    int b = 63 - __builtin_clzll(mask);
+    mask &= ~((uint64_t) 1 << b);
+
+    int item_found = found || ((db->required >> b) & 1);
+
+    *(suffix-suff_len-1) = db->items[b];
+    if (item_found) {
+      fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, supp);
+    }
+
+    if (fpt_can_extend(cons, suff_len+1)) {
+      fpt_bitmap_mine_single_path(db, mask, supp, item_found, suffix, suff_len+1, freq_itemsets, cons);
+    }
+  }
+}
+
+/*
+ * @brief Find frequent itemsets of a bitmap conditional database. Items are
+ *        taken from the largest down and projected on by masking off every
+ *        larger bit, so itemsets come out in the same order as from a tree.
+ *
+ * @param db Conditional database
+ * @param supp Support of each bit of database
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_bitmap_find_frequent_itemsets(
+    fpt_bitmap_db * db,
+    const int * supp,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+  int found = fpt_has_required(cons, &suffix[-1 * suff_len], suff_len);
+
+  for (int b=db->num_items-1; b>=0; b--) {
+    if (supp[b] < min_freq) {
+      continue;
+    }
+
+    int item_found = found || ((db->required >> b) & 1);
+
+    *(suffix-suff_len-1) = db->items[b];
+    if (item_found) {
+      fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, supp[b]);
+    }
+
+    if (!fpt_can_extend(cons, suff_len+1)) {
+      continue;
+    }
+
+    /* Support of each smaller item among the paths containing b */
+    uint64_t bit = (uint64_t) 1 << b;
+    uint64_t common = bit-1;
+    int cond_supp[64] = {0};
+    int num_paths = 0;
+    for (int p=0; p<db->num_paths; p++) {
+      if (db->masks[p] & bit) {
+        for (uint64_t m = db->masks[p] & (bit-1); m != 0; m &= m-1) {
+          cond_supp[__builtin_ctzll(m)] += db->counts[p];
+        }
+        common &= db->masks[p];
+        num_paths++;
+      }
+    }
+
+    uint64_t freq_mask = 0;
+    for (int c=0; c<b; c++) {
+      if (cond_supp[c] >= min_freq) {
+        freq_mask |= (uint64_t) 1 << c;
+      }
+    }
+    if (freq_mask == 0 || (!item_found && (freq_mask & db->required) == 0)) {
+      continue;
+    }
+
+    /* When every path holds all frequent items they project to one path,
+     * whose subsets are all frequent with the support of b */
+    if ((common & freq_mask) == freq_mask) {
+      fpt_bitmap_mine_single_path(db, freq_mask, supp[b], item_found, suffix, suff_len+1, freq_itemsets, cons);
+      continue;
+    }
+
+    fpt_arena * arena = arenas[suff_len+1];
+    fpt_bitmap_db * cond_db = fpt_arena_alloc(arena, sizeof(*cond_db));
+    memcpy(cond_db->items, db->items, b * sizeof(*db->items));
+    cond_db->num_items = 64 - __builtin_clzll(freq_mask);
+    cond_db->required = db->required & freq_mask;
+    int * slots = fpt_bitmap_db_reserve(cond_db, num_paths, arena);
+    for (int p=0; p<db->num_paths; p++) {
+      uint64_t mask = db->masks[p] & freq_mask;
+      if ((db->masks[p] & bit) && mask != 0) {
+        fpt_bitmap_db_add(cond_db, slots, mask, db->counts[p]);
+      }
+    }
+
+    fpt_bitmap_find_frequent_itemsets(cond_db, cond_supp, min_freq, suffix, suff_len+1, freq_itemsets, arenas, cons);
+    fpt_arena_reset(arena);
+  }
+}
+
+void fpt_find_frequent_itemsets(
+    fpt_node * tree,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons);
+
+/*
+ * @brief Find frequent itemsets ending with a given item followed by current suffix
+ *
+ * @param tree Pointer to root of FP tree
+ * @param item Item to add to suffix
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_mine_suffix_item(
+    fpt_node * tree,
+    int item,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+  *(suffix-suff_len-1) = item;
+  suff_len += 1;
+
+  int found = fpt_has_required(cons, &suffix[-1 * suff_len], suff_len);
+  if (found) {
+    int count = fpt_count_item(tree->item_array[item-1]);
+    fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * suff_len], suff_len, count);
+  }
+
+  if (!fpt_can_extend(cons, suff_len)) {
+    return;
+  }
+
+  /* Conditional trees on this level live in their own arena, so the whole tree is released at once */
+  int * counts = fpt_prefix_counts(tree, item, arenas[suff_len]);
+
+  /* Without a required item so far, the prefix paths must hold a frequent one */
+  if (!found) {
+    int i = 0;
+    while (i < item-1 && !(cons->required[i] && counts[i] >= min_freq)) {
+      i++;
+    }
+    if (i == item-1) {
+      fpt_arena_reset(arenas[suff_len]);
+      return;
+    }
+  }
+
+  int supp[64];
+  fpt_bitmap_db * db = fpt_create_conditional_bitmaps(tree, item, counts, min_freq, supp, cons, arenas[suff_len]);
+  if (db != NULL) {
+    fpt_bitmap_find_frequent_itemsets(db, supp, min_freq, suffix, suff_len, freq_itemsets, arenas, cons);
+  }
+  else {
+    fpt_node * cond_tree = fpt_build_conditional_tree(tree, item, counts, min_freq, arenas[suff_len]);
+    fpt_find_frequent_itemsets(cond_tree, min_freq, suffix, suff_len, freq_itemsets, arenas, cons);
+  }
+
+  fpt_arena_reset(arenas[suff_len]);
+}
+
+/*
+ * @brief Find frequent itemsets
+ *
+ * @param tree Pointer to root of FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_find_frequent_itemsets(
+    fpt_node * tree,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+    fpt_node * path_end = fpt_single_path(tree);
+    if (path_end != NULL) {
+      fpt_mine_single_path(path_end, 0, suffix, suff_len, freq_itemsets, cons);
+      return;
+    }
+
+    for (int i=tree->max_item_ID; i>0; i--) {
+      if (tree->item_array[i-1] != NULL) {
+        fpt_mine_suffix_item(tree, i, min_freq, suffix, suff_len, freq_itemsets, arenas, cons);
+      }
+    }
+}
+
+/*
+ * @brief Create an empty tree of found closed or maximal itemsets (CFI / MFI
+ *        tree). Itemsets are stored as paths in ascending item order, and each
+ *        node holds the largest support of the itemsets passing through it.
+ *
+ * @param max_item_ID Largest item ID that can be stored
+ * @param arena Arena to allocate tree from
+ *
+ * @return Pointer to root of tree
+ */
+fpt_node * fpt_cfi_tree_init(
+    int max_item_ID,
+    fpt_arena * arena)
+{
+  fpt_node * root = fpt_new_node(arena);
+  root->item_array = fpt_arena_calloc(arena, (max_item_ID > 0) ? max_item_ID : 1, sizeof(*root->item_array));
+  root->root = root;
+  root->max_item_ID = max_item_ID;
+
+  return root;
+}
+
+/*
+ * @brief Insert an itemset into a CFI / MFI tree, keeping item pointers up to date
+ *
+ * @param tree Pointer to root of tree
+ * @param path Items of itemset in ascending order
+ * @param len Number of items in itemset
+ * @param supp Support of itemset
+ * @param arena Arena to allocate new nodes from
+ */
+void fpt_cfi_tree_insert(
+    fpt_node * tree,
+    const int * path,
+    int len,
+    int supp,
+    fpt_arena * arena)
+{
+  fpt_node * current_node = tree;
+
+  for (int j=0; j<len; j++) {
+    fpt_node * child = fpt_find_child(current_node, path[j]);
+
+    if (child == NULL) {
+      child = fpt_add_child_node(current_node, path[j], arena);
+      child->ngbr = tree->item_array[path[j]-1];
+      tree->item_array[path[j]-1] = child;
+    }
+    if (supp > child->count) {
+      child->count = supp;
+    }
+
+    current_node = child;
+  }
+}
+
+/*
+ * @brief Project a CFI / MFI tree onto the itemsets containing an item. Each
+ *        is cut to its items below the item.
+ *
+ * @param tree Pointer to root of tree
+ * @param item ID of item to project on
+ * @param arena Arena to allocate projected tree from
+ *
+ * @return Pointer to root of projected tree
+ */
+fpt_node * fpt_cfi_tree_project(
+    fpt_node * tree,
+    int item,
+    fpt_arena * arena)
+{
+  fpt_node * proj = fpt_cfi_tree_init(item-1, arena);
+  int * path = fpt_arena_alloc(arena, item * sizeof(*path));
+
+  for (fpt_node * node = tree->item_array[item-1]; node != NULL; node = node->ngbr) {
+    int start = item;
+    for (fpt_node * parent = node->parent; parent != tree; parent = parent->parent) {
+      path[--start] = parent->item;
+    }
+    fpt_cfi_tree_insert(proj, &path[start], item-start, node->count, arena);
+  }
+
+  return proj;
+}
+
+/*
+ * @brief Check whether a CFI / MFI tree holds a superset of an itemset
+ *
+ * @param tree Pointer to root of tree
+ * @param items Items of itemset in ascending order
+ * @param len Number of items in itemset (at least one)
+ *
+ * @return 1 if some itemset in tree contains every item, 0 otherwise
+ */
+int fpt_cfi_tree_contains(
+    fpt_node * tree,
+    const int * items,
+    int len)
+{
+  /* Walk up from each node of the largest item, matching the rest in descending order */
+  for (fpt_node * node = tree->item_array[items[len-1]-1]; node != NULL; node = node->ngbr) {
+    int k = len-2;
+    for (fpt_node * parent = node->parent; parent != tree && k >= 0 && parent->item >= items[k]; parent = parent->parent) {
+      if (parent->item == items[k]) {
+        k--;
+      }
+    }
+    if (k < 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * @brief Find closed or maximal frequent itemsets (FPclose / FPmax). Items are
+ *        added in the same order as fpt_find_frequent_itemsets, which finds
+ *        every superset of an itemset that is not in its conditional tree
+ *        before the itemset itself.
+ *
+ *        Subsumption is checked against CFI / MFI trees of the itemsets found
+ *        so far: found[k] holds, for every found itemset containing the
+ *        current suffix of length k, its items below the suffix. Entering an
+ *        item projects found[k] onto it through its item pointers, and a new
+ *        itemset is inserted into the trees of all its suffixes.
+ *        - closed: an itemset is skipped with its whole conditional tree if a
+ *          found superset has the same support, and is not closed if an item
+ *          of its conditional tree has the same support
+ *        - maximal: an itemset is skipped with its whole conditional tree if
+ *          a found itemset contains it and all items of the conditional tree,
+ *          and is maximal if its conditional tree is empty and no found
+ *          itemset contains it
+ *
+ * @param tree Pointer to root of FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param mode FPT_MODE_CLOSED or FPT_MODE_MAXIMAL
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding closed or maximal itemsets
+ * @param found CFI / MFI trees of found itemsets projected onto each level (indexed by suffix length)
+ * @param found_arenas Arenas for the trees in found (indexed by suffix length)
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ */
+void fpt_find_closed_itemsets(
+    fpt_node * tree,
+    int min_freq,
+    fpt_mode mode,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_node ** found,
+    fpt_arena ** found_arenas,
+    fpt_arena ** arenas)
+{
+  fpt_node * level = found[suff_len];
+
+  for (int i=tree->max_item_ID; i>0; i--) {
+    if (tree->item_array[i-1] == NULL) {
+      continue;
+    }
+
+    *(suffix-suff_len-1) = i;
+    int len = suff_len + 1;
+    int * itemset = &suffix[-len];
+
+    int count = fpt_count_item(tree->item_array[i-1]);
+
+    /* Found supersets never have more support, so the largest is enough */
+    if (mode == FPT_MODE_CLOSED) {
+      int subsumed = 0;
+      for (fpt_node * node = level->item_array[i-1]; node != NULL && !subsumed; node = node->ngbr) {
+        subsumed = (node->count == count);
+      }
+      if (subsumed) {
+        continue;
+      }
+    }
+
+    fpt_arena_reset(found_arenas[len]);
+    fpt_node * next = fpt_cfi_tree_project(level, i, found_arenas[len]);
+    found[len] = next;
+
+    fpt_node * cond_tree = fpt_create_conditional_tree(tree, i, min_freq, arenas[len]);
+
+    /* Items of conditional tree are written in front of itemset */
+    int tail_len = 0;
+    int full = 0;
+    for (int j=cond_tree->max_item_ID; j>0; j--) {
+      if (cond_tree->item_array[j-1] != NULL) {
+        itemset[-(++tail_len)] = j;
+        if (fpt_count_item(cond_tree->item_array[j-1]) == count) {
+          full = 1;
+        }
+      }
+    }
+
+    int emit = 0;
+    int recurse = 0;
+
+    if (mode == FPT_MODE_CLOSED) {
+      emit = !full;
+      recurse = (tail_len > 0);
+    }
+    else if (tail_len == 0) {
+      emit = (level->item_array[i-1] == NULL);
+    }
+    else {
+      recurse = !fpt_cfi_tree_contains(next, itemset - tail_len, tail_len);
+    }
+
+    if (emit) {
+      fpt_freq_itemsets_add(freq_itemsets, itemset, len, count);
+      for (int k=0; k<len; k++) {
+        fpt_cfi_tree_insert(found[k], itemset, len-k, count, found_arenas[k]);
+      }
+    }
+
+    if (recurse) {
+      fpt_find_closed_itemsets(cond_tree, min_freq, mode, suffix, len, freq_itemsets, found, found_arenas, arenas);
+    }
+
+    fpt_arena_reset(arenas[len]);
+  }
+}
+
+/*
+ * @brief Merge itemsets mined by separate threads in order of their suffix item
+ *
+ * @param freq_itemsets Container to hold merged frequent itemsets
+ * @param thread_itemsets Frequent itemsets found by each thread
+ * @param max_item_ID Largest item ID
+ * @param seg_thread Thread that mined each suffix item
+ * @param seg_first Index of first itemset of each suffix item in its thread's container
+ * @param seg_last One past index of last itemset of each suffix item in its thread's container
+ */
+void fpt_merge_thread_itemsets(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_freq_itemsets ** thread_itemsets,
+    int max_item_ID,
+    int * seg_thread,
+    int * seg_first,
+    int * seg_last)
+{
+  /* Serial algorithm handles suffix items from largest to smallest */
+  for (int i=max_item_ID; i>0; i--) {
+    fpt_freq_itemsets_append(freq_itemsets, thread_itemsets[seg_thread[i-1]], seg_first[i-1], seg_last[i-1]);
+  }
+}
+
+/*
+ * @brief Mine suffix items in parallel, each thread with its own scratch space
+ *        and container, then merge the itemsets in the order the serial
+ *        algorithm finds them. Only items with (item-1) % num_parts == part
+ *        are mined, so ranks can split items between them.
+ *
+ * @param miner How the engine mines one suffix item
+ * @param max_item_ID Largest item ID
+ * @param part Part of the items to mine
+ * @param num_parts Number of parts the items are split into
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param seg_first Filled with index of first itemset of each mined suffix item in freq_itemsets (NULL to skip)
+ * @param seg_last Filled with one past index of last itemset of each mined suffix item in freq_itemsets (NULL to skip)
+ */
+void fpt_mine_suffix_items_parallel(
+    const fpt_suffix_miner * miner,
+    int max_item_ID,
+    int part,
+    int num_parts,
+    fpt_freq_itemsets * freq_itemsets,
+    int * seg_first,
+    int * seg_last)
+{
+  int num_threads = omp_get_max_threads();
+
+  fpt_freq_itemsets ** thread_itemsets = malloc(num_threads * sizeof(*thread_itemsets));
+  int * thread_seg_thread = calloc(max_item_ID, sizeof(*thread_seg_thread));
+  int * thread_seg_first = calloc(max_item_ID, sizeof(*thread_seg_first));
+  int * thread_seg_last = calloc(max_item_ID, sizeof(*thread_seg_last));
+
+  #pragma omp parallel
+  {
+    int tid = omp_get_thread_num();
+
+    fpt_freq_itemsets * local_itemsets = fpt_freq_itemsets_init();
+    thread_itemsets[tid] = local_itemsets;
+
+    void * scratch = miner->scratch_init(miner->data);
+    int * suffix = malloc(max_item_ID * sizeof(*suffix));
+
+    #pragma omp for schedule(dynamic, 1)
+    for (int i=max_item_ID; i>0; i--) {
+      if ((i-1) % num_parts == part) {
+        thread_seg_thread[i-1] = tid;
+        thread_seg_first[i-1] = local_itemsets->supports->num_elements;
+        miner->mine(miner->data, scratch, i, suffix + max_item_ID, local_itemsets);
+        thread_seg_last[i-1] = local_itemsets->supports->num_elements;
+      }
+    }
+
+    miner->scratch_free(miner->data, scratch);
+    free(suffix);
+  }
+
+  int num_found = freq_itemsets->supports->num_elements;
+  for (int i=max_item_ID; i>0; i--) {
+    if (seg_first != NULL && (i-1) % num_parts == part) {
+      seg_first[i-1] = num_found;
+      seg_last[i-1] = num_found + thread_seg_last[i-1] - thread_seg_first[i-1];
+    }
+    num_found += thread_seg_last[i-1] - thread_seg_first[i-1];
+  }
+  fpt_merge_thread_itemsets(freq_itemsets, thread_itemsets, max_item_ID, thread_seg_thread, thread_seg_first, thread_seg_last);
+
+  for (int i=0; i<num_threads; i++) {
+    fpt_freq_itemsets_free(thread_itemsets[i]);
+  }
+  free(thread_itemsets);
+  free(thread_seg_thread);
+  free(thread_seg_first);
+  free(thread_seg_last);
+}
+
+/*
+ * @brief Allocate arenas for each level of recursion of a thread
+ *
+ * @param data FP tree engine state (fpt_tree_miner)
+ *
+ * @return Array of arenas
+ */
+void * fpt_tree_miner_scratch_init(
+    void * data)
+{
+  fpt_tree_miner * miner = data;
+  int max_item_ID = miner->tree->max_item_ID;
+
+  fpt_arena ** local_arenas = malloc((max_item_ID+1) * sizeof(*local_arenas));
+  for (int i=0; i<=max_item_ID; i++) {
+    local_arenas[i] = fpt_arena_init();
+  }
+
+  return local_arenas;
+}
+
+/*
+ * @brief Mine a suffix item of an FP tree with a thread's arenas
+ *
+ * @param data FP tree engine state (fpt_tree_miner)
+ * @param scratch Arenas of thread
+ * @param item Suffix item
+ * @param suffix Suffix buffer (points one past last element)
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_tree_miner_mine(
+    void * data,
+    void * scratch,
+    int item,
+    int * suffix,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_tree_miner * miner = data;
+
+  if (miner->tree->item_array[item-1] != NULL) {
+    fpt_mine_suffix_item(miner->tree, item, miner->min_freq, suffix, 0, freq_itemsets, scratch, miner->cons);
+  }
+}
+
+/*
+ * @brief Add allocation statistics of a thread's arenas to the shared ones and free them
+ *
+ * @param data FP tree engine state (fpt_tree_miner)
+ * @param scratch Arenas of thread
+ */
+void fpt_tree_miner_scratch_free(
+    void * data,
+    void * scratch)
+{
+  fpt_tree_miner * miner = data;
+  fpt_arena ** local_arenas = scratch;
+  int max_item_ID = miner->tree->max_item_ID;
+
+  #pragma omp critical
+  {
+    for (int i=1; i<=max_item_ID; i++) {
+      miner->arenas[i]->nodes_allocated += local_arenas[i]->nodes_allocated;
+      miner->arenas[i]->bytes_allocated += local_arenas[i]->bytes_allocated;
+      miner->arenas[i]->bytes_reserved += local_arenas[i]->bytes_reserved;
+    }
+  }
+
+  for (int i=0; i<=max_item_ID; i++) {
+    fpt_arena_free(local_arenas[i]);
+  }
+  free(local_arenas);
+}
+
+/*
+ * @brief Find frequent itemsets with suffix items of FP tree mined in parallel.
+ *        Conditional trees are built from the shared FP tree, which is only read.
+ *
+ * @param tree Pointer to root of FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion; allocation statistics of all threads are added to these
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_find_frequent_itemsets_parallel(
+    fpt_node * tree,
+    int min_freq,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+  fpt_tree_miner data = {tree, min_freq, cons, arenas};
+  fpt_suffix_miner miner = {&data, fpt_tree_miner_scratch_init, fpt_tree_miner_mine, fpt_tree_miner_scratch_free};
+
+  fpt_mine_suffix_items_parallel(&miner, tree->max_item_ID, 0, 1, freq_itemsets, NULL, NULL);
+}
+
+/*
+ * @brief Create a task for mining a conditional tree
+ *
+ * @param tree Conditional tree to mine
+ * @param arena Arena holding tree (freed with task)
+ * @param suffix Suffix of conditional tree
+ * @param suff_len Length of suffix
+ *
+ * @return Allocated task
+ */
+fpt_task * fpt_task_init(
+    fpt_node * tree,
+    fpt_arena * arena,
+    int * suffix,
+    int suff_len)
+{
+  fpt_task * task = malloc(sizeof(*task));
+
+  task->tree = tree;
+  task->arena = arena;
+  task->suff_len = suff_len;
+  task->suffix = malloc((suff_len > 0 ? suff_len : 1) * sizeof(*task->suffix));
+  if (suff_len > 0) {
+    memcpy(task->suffix, suffix, suff_len * sizeof(*task->suffix));
+  }
+
+  task->freq_itemsets = fpt_freq_itemsets_init();
+
+  task->children_capacity = DYN_ARRAY_INIT_CAPACITY;
+  task->num_children = 0;
+  task->children = malloc(task->children_capacity * sizeof(*task->children));
+  task->splice_pos = malloc(task->children_capacity * sizeof(*task->splice_pos));
+
+  return task;
+}
+
+/*
+ * @brief Free task and its results
+ *
+ * @param task Task to free
+ */
+void fpt_task_free(
+    fpt_task * task)
+{
+  if (task->arena != NULL) {
+    fpt_arena_free(task->arena);
+  }
+  free(task->suffix);
+  fpt_freq_itemsets_free(task->freq_itemsets);
+  free(task->children);
+  free(task->splice_pos);
+  free(task);
+}
+
+/*
+ * @brief Record a child task whose itemsets follow those its parent has found so far
+ *
+ * @param task Parent task
+ * @param child Child task
+ */
+void fpt_task_add_child(
+    fpt_task * task,
+    fpt_task * child)
+{
+  if (task->num_children == task->children_capacity) {
+    task->children_capacity *= 2;
+    task->children = realloc(task->children, task->children_capacity * sizeof(*task->children));
+    task->splice_pos = realloc(task->splice_pos, task->children_capacity * sizeof(*task->splice_pos));
+  }
+
+  task->children[task->num_children] = child;
+  task->splice_pos[task->num_children] = task->freq_itemsets->supports->num_elements;
+  task->num_children++;
+}
+
+/*
+ * @brief Append itemsets of a task and its children in serial order, freeing tasks along the way
+ *
+ * @param freq_itemsets Container to append itemsets to
+ * @param task Task to collect itemsets from
+ */
+void fpt_task_collect(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_task * task)
+{
+  int pos = 0;
+
+  for (int i=0; i<task->num_children; i++) {
+    fpt_freq_itemsets_append(freq_itemsets, task->freq_itemsets, pos, task->splice_pos[i]);
+    fpt_task_collect(freq_itemsets, task->children[i]);
+    pos = task->splice_pos[i];
+  }
+  fpt_freq_itemsets_append(freq_itemsets, task->freq_itemsets, pos, task->freq_itemsets->supports->num_elements);
+
+  fpt_task_free(task);
+}
+
+/*
+ * @brief Push task onto bottom of queue
+ *
+ * @param deque Queue of tasks
+ * @param task Task to push
+ */
+void fpt_deque_push(
+    fpt_deque * deque,
+    fpt_task * task)
+{
+  omp_set_lock(&deque->lock);
+
+  if (deque->bottom == deque->capacity) {
+    /* Slide tasks to front before growing */
+    int num_tasks = deque->bottom - deque->top;
+    memmove(deque->tasks, &deque->tasks[deque->top], num_tasks * sizeof(*deque->tasks));
+    deque->top = 0;
+    deque->bottom = num_tasks;
+
+    if (deque->bottom == deque->capacity) {
+      deque->capacity *= 2;
+      deque->tasks = realloc(deque->tasks, deque->capacity * sizeof(*deque->tasks));
+    }
+  }
+  deque->tasks[deque->bottom++] = task;
+
+  omp_unset_lock(&deque->lock);
+}
+
+/*
+ * @brief Take newest task from bottom of queue
+ *
+ * @param deque Queue of tasks
+ *
+ * @return Task, or NULL if queue is empty
+ */
+fpt_task * fpt_deque_pop(
+    fpt_deque * deque)
+{
+  fpt_task * task = NULL;
+
+  omp_set_lock(&deque->lock);
+  if (deque->bottom > deque->top) {
+    task = deque->tasks[--deque->bottom];
+  }
+  omp_unset_lock(&deque->lock);
+
+  return task;
+}
+
+/*
+ * @brief Take oldest task from top of queue
+ *
+ * @param deque Queue of tasks
+ *
+ * @return Task, or NULL if queue is empty
+ */
+fpt_task * fpt_deque_steal(
+    fpt_deque * deque)
+{
+  fpt_task * task = NULL;
+
+  omp_set_lock(&deque->lock);
+  if (deque->bottom > deque->top) {
+    task = deque->tasks[deque->top++];
+  }
+  omp_unset_lock(&deque->lock);
+
+  return task;
+}
+
+/*
+ * @brief Mine a tree on behalf of a task. Conditional trees with enough prefix
+ *        paths are handed off as new tasks while fewer than max_pending tasks
+ *        are unfinished; the rest are mined in place.
+ *
+ * @param sched Scheduler
+ * @param worker_id ID of worker running task
+ * @param task Task being run
+ * @param tree Tree to mine
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ */
+void fpt_ws_mine(
+    fpt_scheduler * sched,
+    int worker_id,
+    fpt_task * task,
+    fpt_node * tree,
+    int * suffix,
+    int suff_len)
+{
+  fpt_worker * worker = &sched->workers[worker_id];
+
+  fpt_node * path_end = fpt_single_path(tree);
+  if (path_end != NULL) {
+    fpt_mine_single_path(path_end, 0, suffix, suff_len, task->freq_itemsets, NULL);
+    return;
+  }
+
+  for (int i=tree->max_item_ID; i>0; i--) {
+    if (tree->item_array[i-1] == NULL) {
+      continue;
+    }
+
+    *(suffix-suff_len-1) = i;
+
+    int count = 0;
+    int num_paths = 0;
+    for (fpt_node * node = tree->item_array[i-1]; node != NULL; node = node->ngbr) {
+      count += node->count;
+      num_paths++;
+    }
+    fpt_freq_itemsets_add(task->freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, count);
+
+    long pending;
+    #pragma omp atomic read
+    pending = sched->pending;
+
+    if (num_paths >= sched->task_threshold && pending < sched->max_pending) {
+      fpt_arena * arena = (worker->num_spare_arenas > 0) ? worker->spare_arenas[--worker->num_spare_arenas] : fpt_arena_init();
+      fpt_node * cond_tree = fpt_create_conditional_tree(tree, i, sched->min_freq, arena);
+      fpt_task * child = fpt_task_init(cond_tree, arena, &suffix[-1 * (suff_len+1)], suff_len+1);
+
+      fpt_task_add_child(task, child);
+
+      #pragma omp atomic
+      sched->pending++;
+      fpt_deque_push(&sched->deques[worker_id], child);
+    }
+    else {
+      fpt_node * cond_tree = fpt_create_conditional_tree(tree, i, sched->min_freq, worker->arenas[suff_len+1]);
+      fpt_ws_mine(sched, worker_id, task, cond_tree, suffix, suff_len+1);
+      fpt_arena_reset(worker->arenas[suff_len+1]);
+    }
+  }
+}
+
+/*
+ * @brief Run tasks until every task has finished
+ *
+ * @param sched Scheduler
+ * @param worker_id ID of worker
+ */
+void fpt_ws_worker_loop(
+    fpt_scheduler * sched,
+    int worker_id)
+{
+  fpt_worker * worker = &sched->workers[worker_id];
+  unsigned int seed = worker_id + 1;
+
+  while (1) {
+    fpt_task * task = fpt_deque_pop(&sched->deques[worker_id]);
+
+    if (task == NULL) {
+      double idle_start = monotonic_seconds();
+
+      while (task == NULL) {
+        long pending;
+        #pragma omp atomic read
+        pending = sched->pending;
+        if (pending == 0) {
+          break;
+        }
+
+        /* Try every other worker starting from a random one */
+        int first = rand_r(&seed) % sched->num_workers;
+        for (int v=0; v<sched->num_workers && task == NULL; v++) {
+          int victim = (first + v) % sched->num_workers;
+          if (victim != worker_id) {
+            task = fpt_deque_steal(&sched->deques[victim]);
+          }
+        }
+        if (task != NULL) {
+          worker->steals++;
+        }
+        else {
+          sched_yield();
+        }
+      }
+
+      worker->idle_time += monotonic_seconds() - idle_start;
+
+      if (task == NULL) {
+        return;
+      }
+    }
+
+    /* Copy suffix of task into this worker's buffer */
+    memcpy(worker->suffix - task->suff_len, task->suffix, task->suff_len * sizeof(*task->suffix));
+    fpt_ws_mine(sched, worker_id, task, task->tree, worker->suffix, task->suff_len);
+
+    /* Tree is no longer needed, but results are kept until all tasks finish */
+    if (task->arena != NULL) {
+      worker->arenas[task->suff_len]->nodes_allocated += task->arena->nodes_allocated;
+      worker->arenas[task->suff_len]->bytes_allocated += task->arena->bytes_allocated;
+      task->arena->nodes_allocated = 0;
+      task->arena->bytes_allocated = 0;
+      fpt_arena_reset(task->arena);
+
+      if (worker->num_spare_arenas == worker->spare_capacity) {
+        worker->spare_capacity *= 2;
+        worker->spare_arenas = realloc(worker->spare_arenas, worker->spare_capacity * sizeof(*worker->spare_arenas));
+      }
+      worker->spare_arenas[worker->num_spare_arenas++] = task->arena;
+      task->arena = NULL;
+    }
+    worker->tasks_run++;
+
+    #pragma omp atomic
+    sched->pending--;
+  }
+}
+
+/*
+ * @brief Find frequent itemsets with a work-stealing scheduler. Any conditional
+ *        tree with at least task_threshold prefix paths becomes a task that idle
+ *        workers can steal.
+ *
+ * @param tree Pointer to root of FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param task_threshold Minimum number of prefix paths for a conditional tree to become a task
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion; allocation statistics of all workers are added to these
+ *
+ * @return Statistics of each worker (one per OpenMP thread)
+ */
+fpt_worker * fpt_find_frequent_itemsets_ws(
+    fpt_node * tree,
+    int min_freq,
+    int task_threshold,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas)
+{
+  int max_item_ID = tree->max_item_ID;
+
+  fpt_scheduler sched;
+  sched.num_workers = omp_get_max_threads();
+  sched.min_freq = min_freq;
+  sched.task_threshold = task_threshold;
+  sched.max_pending = (long) WS_MAX_PENDING_PER_WORKER * sched.num_workers;
+  sched.deques = malloc(sched.num_workers * sizeof(*sched.deques));
+  sched.workers = malloc(sched.num_workers * sizeof(*sched.workers));
+
+  for (int w=0; w<sched.num_workers; w++) {
+    sched.deques[w].capacity = DYN_ARRAY_INIT_CAPACITY;
+    sched.deques[w].tasks = malloc(sched.deques[w].capacity * sizeof(*sched.deques[w].tasks));
+    sched.deques[w].top = 0;
+    sched.deques[w].bottom = 0;
+    omp_init_lock(&sched.deques[w].lock);
+
+    sched.workers[w].arenas = malloc((max_item_ID+1) * sizeof(*sched.workers[w].arenas));
+    for (int i=0; i<=max_item_ID; i++) {
+      sched.workers[w].arenas[i] = fpt_arena_init();
+    }
+    sched.workers[w].suffix = malloc(max_item_ID * sizeof(*sched.workers[w].suffix));
+    sched.workers[w].suffix += max_item_ID;
+    sched.workers[w].spare_capacity = DYN_ARRAY_INIT_CAPACITY;
+    sched.workers[w].num_spare_arenas = 0;
+    sched.workers[w].spare_arenas = malloc(sched.workers[w].spare_capacity * sizeof(*sched.workers[w].spare_arenas));
+    sched.workers[w].tasks_run = 0;
+    sched.workers[w].steals = 0;
+    sched.workers[w].idle_time = 0;
+  }
+
+  /* Whole FP tree is the first task */
+  fpt_task * root_task = fpt_task_init(tree, NULL, NULL, 0);
+  sched.pending = 1;
+  fpt_deque_push(&sched.deques[0], root_task);
+
+  #pragma omp parallel num_threads(sched.num_workers)
+  {
+    fpt_ws_worker_loop(&sched, omp_get_thread_num());
+  }
+
+  fpt_task_collect(freq_itemsets, root_task);
+
+  for (int w=0; w<sched.num_workers; w++) {
+    for (int i=0; i<=max_item_ID; i++) {
+      if (i > 0) {
+        arenas[i]->nodes_allocated += sched.workers[w].arenas[i]->nodes_allocated;
+        arenas[i]->bytes_allocated += sched.workers[w].arenas[i]->bytes_allocated;
+        arenas[i]->bytes_reserved += sched.workers[w].arenas[i]->bytes_reserved;
+      }
+      fpt_arena_free(sched.workers[w].arenas[i]);
+    }
+    for (int i=0; i<sched.workers[w].num_spare_arenas; i++) {
+      fpt_arena_free(sched.workers[w].spare_arenas[i]);
+    }
+    free(sched.workers[w].spare_arenas);
+    free(sched.workers[w].arenas);
+    free(sched.workers[w].suffix - max_item_ID);
+    sched.workers[w].arenas = NULL;
+    sched.workers[w].suffix = NULL;
+    sched.workers[w].spare_arenas = NULL;
+    sched.workers[w].num_spare_arenas = 0;
+
+    free(sched.deques[w].tasks);
+    omp_destroy_lock(&sched.deques[w].lock);
+  }
+
+  free(sched.deques);
+
+  return sched.workers;
+}
+
+/*
+ * @brief Initialize an empty compact FP tree
+ *
+ * @return Allocated compact FP tree
+ */
+fpt_ctree * fpt_ctree_init()
+{
+  fpt_ctree * tree = malloc(sizeof(*tree));
+
+  tree->num_nodes = 0;
+  tree->node_capacity = 0;
+  tree->max_item_ID = 0;
+  tree->item_capacity = 0;
+
+  tree->item = NULL;
+  tree->count = NULL;
+  tree->parent = NULL;
+  tree->map = NULL;
+  tree->item_start = NULL;
+  tree->item_supp = NULL;
+  tree->item_cursor = NULL;
+
+  return tree;
+}
+
+/*
+ * @brief Make sure compact FP tree has room for nodes and items. Existing
+ *        contents are not preserved.
+ *
+ * @param tree Compact FP tree
+ * @param num_nodes Number of nodes needed
+ * @param max_item_ID Largest item ID needed
+ */
+void fpt_ctree_reserve(
+    fpt_ctree * tree,
+    int num_nodes,
+    int max_item_ID)
+{
+  if (num_nodes > tree->node_capacity) {
+    int capacity = (tree->node_capacity > 0) ? tree->node_capacity : DYN_ARRAY_INIT_CAPACITY;
+    while (capacity < num_nodes) {
+      capacity *= 2;
+    }
+
+    free(tree->item);
+    free(tree->count);
+    free(tree->parent);
+    free(tree->map);
+    tree->item = malloc(capacity * sizeof(*tree->item));
+    tree->count = malloc(capacity * sizeof(*tree->count));
+    tree->parent = malloc(capacity * sizeof(*tree->parent));
+    tree->map = malloc(capacity * sizeof(*tree->map));
+    for (int i=0; i<capacity; i++) {
+      tree->map[i] = -1;
+    }
+    tree->node_capacity = capacity;
+  }
+
+  if (max_item_ID+1 > tree->item_capacity) {
+    free(tree->item_start);
+    free(tree->item_supp);
+    free(tree->item_cursor);
+    tree->item_start = malloc((max_item_ID+1) * sizeof(*tree->item_start));
+    tree->item_supp = malloc((max_item_ID+1) * sizeof(*tree->item_supp));
+    tree->item_cursor = malloc((max_item_ID+1) * sizeof(*tree->item_cursor));
+    tree->item_capacity = max_item_ID+1;
+  }
+}
+
+/*
+ * @brief Free compact FP tree
+ *
+ * @param tree Compact FP tree to free
+ */
+void fpt_ctree_free(
+    fpt_ctree * tree)
+{
+  free(tree->item);
+  free(tree->count);
+  free(tree->parent);
+  free(tree->map);
+  free(tree->item_start);
+  free(tree->item_supp);
+  free(tree->item_cursor);
+  free(tree);
+}
+
+/*
+ * @brief Number of bytes used by a compact FP tree
+ *
+ * @param tree Compact FP tree
+ *
+ * @return Bytes held by arrays of tree
+ */
+size_t fpt_ctree_bytes(
+    fpt_ctree * tree)
+{
+  return (size_t) tree->node_capacity * 4 * sizeof(int) + (size_t) tree->item_capacity * 3 * sizeof(int);
+}
+
+/*
+ * @brief Construct compact FP tree
+ *
+ * @param trans CSR array of transactions
+ *
+ * @return tree Compact FP tree
+ */
+fpt_ctree * fpt_ctree_create_fp_tree(
+    fpt_csr * trans)
+{
+  /* Insert transactions into a tree with child lists, then regroup the nodes by item */
+  int capacity = DYN_ARRAY_INIT_CAPACITY;
+  int num_nodes = 0;
+  int * ins_item = malloc(capacity * sizeof(*ins_item));
+  int * ins_count = malloc(capacity * sizeof(*ins_count));
+  int * ins_parent = malloc(capacity * sizeof(*ins_parent));
+  int * first_child = malloc(capacity * sizeof(*first_child));
+  int * next_sibling = malloc(capacity * sizeof(*next_sibling));
+  int root_child = -1;
+
+  /* Add each transaction */
+  for (int i=0; i<trans->nrows; i++) {
+    int current_node = -1;
+
+    /* Add each item from current transaction */
+    for (int j=trans->row_idx[i]; j<trans->row_idx[i+1]; j++) {
+      int child = (current_node == -1) ? root_child : first_child[current_node];
+
+      /* Search for existing path with same item */
+      while (child != -1 && ins_item[child] != trans->val[j]) {
+        child = next_sibling[child];
+      }
+
+      if (child == -1) {                  /* No path with current item found */
+        if (num_nodes == capacity) {
+          capacity *= 2;
+          ins_item = realloc(ins_item, capacity * sizeof(*ins_item));
+          ins_count = realloc(ins_count, capacity * sizeof(*ins_count));
+          ins_parent = realloc(ins_parent, capacity * sizeof(*ins_parent));
+          first_child = realloc(first_child, capacity * sizeof(*first_child));
+          next_sibling = realloc(next_sibling, capacity * sizeof(*next_sibling));
+        }
+
+        child = num_nodes++;
+        ins_item[child] = trans->val[j];
+        ins_count[child] = 0;
+        ins_parent[child] = current_node;
+        first_child[child] = -1;
+
+        if (current_node == -1) {
+          next_sibling[child] = root_child;
+          root_child = child;
+        }
+        else {
+          next_sibling[child] = first_child[current_node];
+          first_child[current_node] = child;
+        }
+      }
+
+      ins_count[child] += 1;
+      current_node = child;               /* Prepare to add next item */
+    }
+  }
+
+  free(first_child);
+  free(next_sibling);
+
+  fpt_ctree * tree = fpt_ctree_init();
+  fpt_ctree_reserve(tree, num_nodes, trans->max_val);
+  tree->num_nodes = num_nodes;
+  tree->max_item_ID = trans->max_val;
+
+  /* Count nodes and support of each item */
+  for (int i=0; i<=tree->max_item_ID; i++) {
+    tree->item_start[i] = 0;
+    tree->item_supp[i] = 0;
+  }
+  for (int i=0; i<num_nodes; i++) {
+    tree->item_start[ins_item[i]] += 1;
+    tree->item_supp[ins_item[i]-1] += ins_count[i];
+  }
+  for (int i=1; i<=tree->max_item_ID; i++) {
+    tree->item_start[i] += tree->item_start[i-1];
+    tree->item_cursor[i-1] = tree->item_start[i-1];
+  }
+
+  /* Parents always have smaller items than children, so they are placed first */
+  int * perm = ins_count;    /* Reuse space for new index of each node once counts are copied */
+  for (int i=0; i<num_nodes; i++) {
+    int pos = tree->item_cursor[ins_item[i]-1]++;
+    tree->item[pos] = ins_item[i];
+    tree->count[pos] = ins_count[i];
+    perm[i] = pos;
+  }
+  for (int i=0; i<num_nodes; i++) {
+    tree->parent[perm[i]] = (ins_parent[i] == -1) ? -1 : perm[ins_parent[i]];
+  }
+
+  free(ins_item);
+  free(ins_count);
+  free(ins_parent);
+
+  return tree;
+}
+
+/*
+ * @brief Create conditional compact FP tree by projecting prefix paths of an item
+ *
+ * @param tree Compact FP tree to project
+ * @param map Scratch space with an entry of -1 for each node of tree
+ * @param item ID of item to project on
+ * @param min_freq Minimum frequency for inclusion in conditional tree
+ * @param cond_tree Compact FP tree to hold result (reused between calls)
+ */
+void fpt_ctree_create_conditional_tree(
+    fpt_ctree * tree,
+    int * map,
+    int item,
+    int min_freq,
+    fpt_ctree * cond_tree)
+{
+  int first = tree->item_start[item-1];
+  int last = tree->item_start[item];
+
+  cond_tree->max_item_ID = item-1;
+  fpt_ctree_reserve(cond_tree, 0, cond_tree->max_item_ID);
+
+  for (int i=0; i<=cond_tree->max_item_ID; i++) {
+    cond_tree->item_supp[i] = 0;
+    cond_tree->item_start[i] = 0;
+  }
+
+  /* Count support of each item in prefix paths */
+  for (int n=first; n<last; n++) {
+    for (int a=tree->parent[n]; a!=-1; a=tree->parent[a]) {
+      cond_tree->item_supp[tree->item[a]-1] += tree->count[n];
+    }
+  }
+
+  /* Mark nodes on prefix paths with frequent items and count them by item */
+  int num_nodes = 0;
+  for (int n=first; n<last; n++) {
+    for (int a=tree->parent[n]; a!=-1; a=tree->parent[a]) {
+      if (cond_tree->item_supp[tree->item[a]-1] >= min_freq) {
+        if (map[a] != -1) {     /* Rest of path has already been marked */
+          break;
+        }
+        map[a] = -2;
+        cond_tree->item_start[tree->item[a]] += 1;
+        num_nodes++;
+      }
+    }
+  }
+
+  fpt_ctree_reserve(cond_tree, num_nodes, cond_tree->max_item_ID);
+  cond_tree->num_nodes = num_nodes;
+
+  for (int i=1; i<=cond_tree->max_item_ID; i++) {
+    cond_tree->item_start[i] += cond_tree->item_start[i-1];
+    cond_tree->item_cursor[i-1] = cond_tree->item_start[i-1];
+  }
+
+  /* Copy marked nodes into conditional tree and accumulate counts along paths */
+  for (int n=first; n<last; n++) {
+    int pending = -1;     /* New node still waiting for its parent */
+    for (int a=tree->parent[n]; a!=-1; a=tree->parent[a]) {
+      if (cond_tree->item_supp[tree->item[a]-1] >= min_freq) {
+        int new_node = map[a];
+        int created = 0;
+        if (new_node == -2) {
+          new_node = cond_tree->item_cursor[tree->item[a]-1]++;
+          map[a] = new_node;
+          cond_tree->item[new_node] = tree->item[a];
+          cond_tree->count[new_node] = 0;
+          created = 1;
+        }
+
+        if (pending != -1) {
+          cond_tree->parent[pending] = new_node;
+        }
+        pending = created ? new_node : -1;
+
+        cond_tree->count[new_node] += tree->count[n];
+      }
+    }
+
+    if (pending != -1) {
+      cond_tree->parent[pending] = -1;
+    }
+  }
+
+  /* Clear scratch space of original tree */
+  for (int n=first; n<last; n++) {
+    for (int a=tree->parent[n]; a!=-1; a=tree->parent[a]) {
+      if (cond_tree->item_supp[tree->item[a]-1] >= min_freq) {
+        if (map[a] == -1) {
+          break;
+        }
+        map[a] = -1;
+      }
+    }
+  }
+}
+
+/*
+ * @brief Check whether a compact FP tree consists of a single path. Nodes are
+ *        grouped by ascending item, so a path is a run of nodes whose parent
+ *        is the previous node.
+ *
+ * @param tree Compact FP tree
+ *
+ * @return 1 if tree is a single path, otherwise 0
+ */
+int fpt_ctree_is_single_path(
+    fpt_ctree * tree)
+{
+  if (tree->num_nodes > 0 && tree->parent[0] != -1) {
+    return 0;
+  }
+
+  for (int k=1; k<tree->num_nodes; k++) {
+    if (tree->parent[k] != k-1) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+/*
+ * @brief Find frequent itemsets of a compact FP tree consisting of a single path
+ *
+ * @param tree Compact FP tree
+ * @param node Deepest node of path that can be added to suffix
+ * @param supp Support of current suffix within path (0 before any path item is added)
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_ctree_mine_single_path(
+    fpt_ctree * tree,
+    int node,
+    int supp,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  for (; node >= 0; node--) {
+    int count = (supp > 0) ? supp : tree->count[node];
+
+    *(suffix-suff_len-1) = tree->item[node];
+    fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, count);
+
+    fpt_ctree_mine_single_path(tree, node-1, count, suffix, suff_len+1, freq_itemsets);
+  }
+}
+
+void fpt_ctree_find_frequent_itemsets(
+    fpt_ctree * tree,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_ctree ** levels);
+
+/*
+ * @brief Find frequent itemsets of compact FP tree ending with a given item followed by current suffix
+ *
+ * @param tree Compact FP tree
+ * @param map Scratch space with an entry of -1 for each node of tree
+ * @param item Item to add to suffix
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param levels Compact FP trees reused for each level of recursion (indexed by suffix length)
+ */
+void fpt_ctree_mine_suffix_item(
+    fpt_ctree * tree,
+    int * map,
+    int item,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_ctree ** levels)
+{
+  *(suffix-suff_len-1) = item;
+  suff_len += 1;
+
+  fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * suff_len], suff_len, tree->item_supp[item-1]);
+
+  fpt_ctree * cond_tree = levels[suff_len];
+  fpt_ctree_create_conditional_tree(tree, map, item, min_freq, cond_tree);
+  if (cond_tree->num_nodes > 0) {
+    fpt_ctree_find_frequent_itemsets(cond_tree, min_freq, suffix, suff_len, freq_itemsets, levels);
+  }
+}
+
+/*
+ * @brief Find frequent itemsets using compact FP trees
+ *
+ * @param tree Compact FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param levels Compact FP trees reused for each level of recursion (indexed by suffix length)
+ */
+void fpt_ctree_find_frequent_itemsets(
+    fpt_ctree * tree,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_ctree ** levels)
+{
+  if (fpt_ctree_is_single_path(tree)) {
+    fpt_ctree_mine_single_path(tree, tree->num_nodes-1, 0, suffix, suff_len, freq_itemsets);
+    return;
+  }
+
+  for (int i=tree->max_item_ID; i>0; i--) {
+    if (tree->item_start[i] > tree->item_start[i-1]) {
+      fpt_ctree_mine_suffix_item(tree, tree->map, i, min_freq, suffix, suff_len, freq_itemsets, levels);
+    }
+  }
+}
+
+/*
+ * @brief Allocate compact FP trees for each level of recursion of a thread
+ *
+ * @param data Compact FP tree engine state (fpt_ctree_miner)
+ *
+ * @return Scratch space (fpt_ctree_scratch)
+ */
+void * fpt_ctree_miner_scratch_init(
+    void * data)
+{
+  fpt_ctree * tree = ((fpt_ctree_miner *) data)->tree;
+  fpt_ctree_scratch * scratch = malloc(sizeof(*scratch));
+
+  scratch->levels = malloc((tree->max_item_ID+1) * sizeof(*scratch->levels));
+  for (int i=0; i<=tree->max_item_ID; i++) {
+    scratch->levels[i] = fpt_ctree_init();
+  }
+
+  scratch->map = malloc(tree->num_nodes * sizeof(*scratch->map));
+  for (int i=0; i<tree->num_nodes; i++) {
+    scratch->map[i] = -1;
+  }
+
+  return scratch;
+}
+
+/*
+ * @brief Mine a suffix item of a compact FP tree with a thread's scratch space
+ *
+ * @param data Compact FP tree engine state (fpt_ctree_miner)
+ * @param scratch Scratch space of thread (fpt_ctree_scratch)
+ * @param item Suffix item
+ * @param suffix Suffix buffer (points one past last element)
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_ctree_miner_mine(
+    void * data,
+    void * scratch,
+    int item,
+    int * suffix,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_ctree_miner * miner = data;
+  fpt_ctree_scratch * local = scratch;
+
+  if (miner->tree->item_start[item] > miner->tree->item_start[item-1]) {
+    fpt_ctree_mine_suffix_item(miner->tree, local->map, item, miner->min_freq, suffix, 0, freq_itemsets, local->levels);
+  }
+}
+
+/*
+ * @brief Free scratch space of a thread of the compact FP tree engine
+ *
+ * @param data Compact FP tree engine state (fpt_ctree_miner)
+ * @param scratch Scratch space of thread (fpt_ctree_scratch)
+ */
+void fpt_ctree_miner_scratch_free(
+    void * data,
+    void * scratch)
+{
+  fpt_ctree * tree = ((fpt_ctree_miner *) data)->tree;
+  fpt_ctree_scratch * local = scratch;
+
+  for (int i=0; i<=tree->max_item_ID; i++) {
+    fpt_ctree_free(local->levels[i]);
+  }
+  free(local->levels);
+  free(local->map);
+  free(local);
+}
+
+/*
+ * @brief Find frequent itemsets with suffix items of compact FP tree mined in
+ *        parallel. Each thread projects the shared tree with its own scratch space.
+ *
+ * @param tree Compact FP tree
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_ctree_find_frequent_itemsets_parallel(
+    fpt_ctree * tree,
+    int min_freq,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_ctree_miner data = {tree, min_freq};
+  fpt_suffix_miner miner = {&data, fpt_ctree_miner_scratch_init, fpt_ctree_miner_mine, fpt_ctree_miner_scratch_free};
+
+  fpt_mine_suffix_items_parallel(&miner, tree->max_item_ID, 0, 1, freq_itemsets, NULL, NULL);
+}
+
+/*
+ * @brief Initialize empty equivalence class
+ *
+ * @return Allocated class
+ */
+fpt_eclat_class * fpt_eclat_class_init()
+{
+  fpt_eclat_class * cls = malloc(sizeof(*cls));
+
+  cls->num_members = 0;
+  cls->capacity = 0;
+  cls->items = NULL;
+  cls->supps = NULL;
+  cls->sets = NULL;
+
+  return cls;
+}
+
+/*
+ * @brief Make sure a class can hold a number of members (contents are lost)
+ *
+ * @param cls Equivalence class
+ * @param num_members Number of members needed
+ * @param words Number of 64-bit words in each bitset
+ */
+void fpt_eclat_class_reserve(
+    fpt_eclat_class * cls,
+    int num_members,
+    int words)
+{
+  if (num_members <= cls->capacity) {
+    return;
+  }
+
+  int capacity = (cls->capacity > 0) ? cls->capacity : 1;
+  while (capacity < num_members) {
+    capacity *= 2;
+  }
+
+  free(cls->items);
+  free(cls->supps);
+  free(cls->sets);
+
+  cls->items = malloc(capacity * sizeof(*cls->items));
+  cls->supps = malloc(capacity * sizeof(*cls->supps));
+  if (posix_memalign((void **) &cls->sets, 64, (size_t) capacity * words * sizeof(*cls->sets)) != 0) {
+    fprintf(stderr, "unable to allocate %zu bytes of bitsets.\n", (size_t) capacity * words * sizeof(*cls->sets));
+    exit(EXIT_FAILURE);
+  }
+  cls->capacity = capacity;
+}
+
+/*
+ * @brief Free equivalence class
+ *
+ * @param cls Class to free
+ */
+void fpt_eclat_class_free(
+    fpt_eclat_class * cls)
+{
+  free(cls->items);
+  free(cls->supps);
+  free(cls->sets);
+  free(cls);
+}
+
+/*
+ * @brief Intersect two bitsets and count the transactions left. Uses AVX-512
+ *        popcount or an AVX2 nibble lookup when compiled for them.
+ *
+ * @param dst Bitset to write intersection to
+ * @param a First bitset
+ * @param b Second bitset
+ * @param words Number of 64-bit words (multiple of 8)
+ *
+ * @return Number of bits set in intersection
+ */
+static inline int fpt_bitset_and_count(
+    uint64_t * dst,
+    const uint64_t * a,
+    const uint64_t * b,
+    int words)
+{
+#if defined(__AVX512F__) && defined(__AVX512VPOPCNTDQ__)
+  __m512i total = _mm512_setzero_si512();
+  for (int w=0; w<words; w+=8) {
+    __m512i v = _mm512_and_si512(_mm512_load_si512((const void *) &a[w]), _mm512_load_si512((const void *) &b[w]));
+    _mm512_store_si512((void *) &dst[w], v);
+    total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+  }
+  return (int) _mm512_reduce_add_epi64(total);
+#elif defined(__AVX2__)
+  const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                          0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i total = _mm256_setzero_si256();
+  for (int w=0; w<words; w+=4) {
+    __m256i v = _mm256_and_si256(_mm256_load_si256((const __m256i *) &a[w]), _mm256_load_si256((const __m256i *) &b[w]));
+    _mm256_store_si256((__m256i *) &dst[w], v);
+    __m256i lo = _mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low_mask));
+    __m256i hi = _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask));
+    total = _mm256_add_epi64(total, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+  }
+  return (int) (_mm256_extract_epi64(total, 0) + _mm256_extract_epi64(total, 1) +
+                _mm256_extract_epi64(total, 2) + _mm256_extract_epi64(total, 3));
+#else
+  int total = 0;
+  for (int w=0; w<words; w++) {
+    dst[w] = a[w] & b[w];
+    total += __builtin_popcountll(dst[w]);
+  }
+  return total;
+#endif
+}
+
+/*
+ * @brief Create class of all items of the relabelled transactions, with the
+ *        bitset of transactions containing each item
+ *
+ * @param trans CSR array of transactions (all items frequent)
+ * @param words Number of 64-bit words in each bitset
+ *
+ * @return Class with one member per item in ascending order
+ */
+fpt_eclat_class * fpt_eclat_create_class(
+    fpt_csr * trans,
+    int words)
+{
+  fpt_eclat_class * cls = fpt_eclat_class_init();
+  fpt_eclat_class_reserve(cls, trans->max_val, words);
+
+  cls->num_members = trans->max_val;
+  memset(cls->sets, 0, (size_t) trans->max_val * words * sizeof(*cls->sets));
+  for (int i=0; i<trans->max_val; i++) {
+    cls->items[i] = i+1;
+    cls->supps[i] = 0;
+  }
+
+  for (int r=0; r<trans->nrows; r++) {
+    for (int j=trans->row_idx[r]; j<trans->row_idx[r+1]; j++) {
+      int m = trans->val[j]-1;
+      cls->sets[(size_t) m * words + r/64] |= (uint64_t) 1 << (r%64);
+      cls->supps[m]++;
+    }
+  }
+
+  return cls;
+}
+
+void fpt_eclat_find_frequent_itemsets(
+    fpt_eclat_class * cls,
+    int words,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_eclat_class ** levels);
+
+/*
+ * @brief Add a member of a class to the suffix and mine the class of its
+ *        extensions, formed by intersecting its bitset with those of the
+ *        members before it
+ *
+ * @param cls Equivalence class of current suffix
+ * @param m Member to add to suffix
+ * @param words Number of 64-bit words in each bitset
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param levels Classes for each level of recursion (indexed by suffix length)
+ */
+void fpt_eclat_mine_member(
+    fpt_eclat_class * cls,
+    int m,
+    int words,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_eclat_class ** levels)
+{
+  *(suffix-suff_len-1) = cls->items[m];
+  suff_len += 1;
+
+  fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * suff_len], suff_len, cls->supps[m]);
+
+  fpt_eclat_class * next = levels[suff_len];
+  fpt_eclat_class_reserve(next, m, words);
+  next->num_members = 0;
+
+  const uint64_t * set = &cls->sets[(size_t) m * words];
+  for (int j=0; j<m; j++) {
+    uint64_t * dst = &next->sets[(size_t) next->num_members * words];
+    int supp = fpt_bitset_and_count(dst, set, &cls->sets[(size_t) j * words], words);
+    if (supp >= min_freq) {
+      next->items[next->num_members] = cls->items[j];
+      next->supps[next->num_members] = supp;
+      next->num_members++;
+    }
+  }
+
+  if (next->num_members > 0) {
+    fpt_eclat_find_frequent_itemsets(next, words, min_freq, suffix, suff_len, freq_itemsets, levels);
+  }
+}
+
+/*
+ * @brief Find frequent itemsets by intersecting transaction bitsets (Eclat).
+ *        Members are visited from the largest item down, so itemsets are found
+ *        in the same order as fpt_find_frequent_itemsets.
+ *
+ * @param cls Equivalence class of current suffix (members in ascending order)
+ * @param words Number of 64-bit words in each bitset
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param levels Classes for each level of recursion (indexed by suffix length)
+ */
+void fpt_eclat_find_frequent_itemsets(
+    fpt_eclat_class * cls,
+    int words,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_eclat_class ** levels)
+{
+  for (int m=cls->num_members-1; m>=0; m--) {
+    fpt_eclat_mine_member(cls, m, words, min_freq, suffix, suff_len, freq_itemsets, levels);
+  }
+}
+
+/*
+ * @brief Allocate classes for each level of recursion of a thread
+ *
+ * @param data Vertical engine state (fpt_eclat_miner)
+ *
+ * @return Array of classes
+ */
+void * fpt_eclat_miner_scratch_init(
+    void * data)
+{
+  int num_members = ((fpt_eclat_miner *) data)->cls->num_members;
+
+  fpt_eclat_class ** local_levels = malloc((num_members+1) * sizeof(*local_levels));
+  for (int i=0; i<=num_members; i++) {
+    local_levels[i] = fpt_eclat_class_init();
+  }
+
+  return local_levels;
+}
+
+/*
+ * @brief Mine a member of the top class with a thread's classes
+ *
+ * @param data Vertical engine state (fpt_eclat_miner)
+ * @param scratch Classes of thread
+ * @param item Member of top class, counted from one
+ * @param suffix Suffix buffer (points one past last element)
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_eclat_miner_mine(
+    void * data,
+    void * scratch,
+    int item,
+    int * suffix,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_eclat_miner * miner = data;
+
+  fpt_eclat_mine_member(miner->cls, item-1, miner->words, miner->min_freq, suffix, 0, freq_itemsets, scratch);
+}
+
+/*
+ * @brief Free classes of a thread
+ *
+ * @param data Vertical engine state (fpt_eclat_miner)
+ * @param scratch Classes of thread
+ */
+void fpt_eclat_miner_scratch_free(
+    void * data,
+    void * scratch)
+{
+  int num_members = ((fpt_eclat_miner *) data)->cls->num_members;
+  fpt_eclat_class ** local_levels = scratch;
+
+  for (int i=0; i<=num_members; i++) {
+    fpt_eclat_class_free(local_levels[i]);
+  }
+  free(local_levels);
+}
+
+/*
+ * @brief Find frequent itemsets with the members of the top class mined in
+ *        parallel by the vertical engine
+ *
+ * @param cls Class of all items
+ * @param words Number of 64-bit words in each bitset
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_eclat_find_frequent_itemsets_parallel(
+    fpt_eclat_class * cls,
+    int words,
+    int min_freq,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_eclat_miner data = {cls, words, min_freq};
+  fpt_suffix_miner miner = {&data, fpt_eclat_miner_scratch_init, fpt_eclat_miner_mine, fpt_eclat_miner_scratch_free};
+
+  fpt_mine_suffix_items_parallel(&miner, cls->num_members, 0, 1, freq_itemsets, NULL, NULL);
+}
+
+/*
+ * @brief Initialize scratch space for rule generation
+ *
+ * @return Empty scratch space
+ */
+fpt_rule_work * fpt_rule_work_init()
+{
+  fpt_rule_work * work = calloc(1, sizeof(*work));
+
+  work->cand_rules = fpt_dyn_array_malloc();
+
+  return work;
+}
+
+/*
+ * @brief Free scratch space for rule generation
+ *
+ * @param work Scratch space
+ */
+void fpt_rule_work_free(
+    fpt_rule_work * work)
+{
+  fpt_dyn_array_free(work->cand_rules);
+  free(work->marker);
+  free(work->lhs);
+  free(work->slots);
+  free(work->stats.generated);
+  free(work->stats.pruned);
+  free(work->stats.accepted);
+  free(work);
+}
+
+/*
+ * @brief Make sure a scratch array has space for a number of elements
+ *
+ * @param buf Scratch array (reallocated if too small)
+ * @param capacity Number of elements buf has space for
+ * @param needed Number of elements needed
+ */
+void fpt_rule_work_reserve(
+    int ** buf,
+    int * capacity,
+    int needed)
+{
+  if (*capacity < needed) {
+    *capacity = (2 * *capacity > needed) ? 2 * *capacity : needed;
+    *buf = realloc(*buf, *capacity * sizeof(**buf));
+  }
+}
+
+/*
+ * @brief Make sure statistics have space for a consequent length
+ *
+ * @param stats Statistics of rule generation
+ * @param level Consequent length
+ */
+void fpt_rule_stats_reserve(
+    fpt_rule_stats * stats,
+    int level)
+{
+  if (level < stats->num_levels) {
+    return;
+  }
+
+  int num_levels = 2 * level + 1;
+  stats->generated = realloc(stats->generated, num_levels * sizeof(*stats->generated));
+  stats->pruned = realloc(stats->pruned, num_levels * sizeof(*stats->pruned));
+  stats->accepted = realloc(stats->accepted, num_levels * sizeof(*stats->accepted));
+  for (int k=stats->num_levels; k<num_levels; k++) {
+    stats->generated[k] = 0;
+    stats->pruned[k] = 0;
+    stats->accepted[k] = 0;
+  }
+  stats->num_levels = num_levels;
+}
+
+/*
+ * @brief Add the statistics of one rule generation run to another
+ *
+ * @param dest Statistics added to
+ * @param src Statistics to add
+ */
+void fpt_rule_stats_add(
+    fpt_rule_stats * dest,
+    const fpt_rule_stats * src)
+{
+  if (src->num_levels > 0) {
+    fpt_rule_stats_reserve(dest, src->num_levels-1);
+  }
+  for (int k=0; k<src->num_levels; k++) {
+    dest->generated[k] += src->generated[k];
+    dest->pruned[k] += src->pruned[k];
+    dest->accepted[k] += src->accepted[k];
+  }
+}
+
+/*
+ * @brief Print candidates generated, pruned and accepted at each consequent length
+ *
+ * @param stats Statistics of rule generation
+ */
+void fpt_print_rule_stats(
+    const fpt_rule_stats * stats)
+{
+  for (int k=1; k<stats->num_levels; k++) {
+    if (stats->generated[k] > 0) {
+      printf("Consequents of %d items: %ld candidates, %ld pruned, %ld accepted\n", k, stats->generated[k], stats->pruned[k], stats->accepted[k]);
+    }
+  }
+}
+
+/*
+ * @brief Check whether a consequent was accepted at the previous length
+ *
+ * @param work Scratch space holding hash table of previous consequents
+ * @param num_slots Number of slots of hash table (power of two)
+ * @param prev_rules Consequents at previous length
+ * @param rule_len Length of previous consequents
+ * @param subset Consequent to find
+ *
+ * @return 1 if found, 0 otherwise
+ */
+static inline int fpt_rule_work_contains(
+    fpt_rule_work * work,
+    int num_slots,
+    const int * prev_rules,
+    int rule_len,
+    const int * subset)
+{
+  unsigned int mask = num_slots - 1;
+
+  for (unsigned int slot = fpt_hash_itemset(subset, rule_len) & mask; work->slots[slot] != -1; slot = (slot + 1) & mask) {
+    if (memcmp(&prev_rules[work->slots[slot] * rule_len], subset, rule_len * sizeof(*subset)) == 0) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/*
+ * @brief Generate rules from an itemset using right-hand sides of rules at previous level in tree.
+ *        Candidates are formed apriori-gen style: consequents sharing all but their last
+ *        item are joined, and a candidate is pruned unless every subset one item shorter
+ *        was itself a confident consequent (confidence only drops as a consequent grows).
+ *
+ * @param itemset Frequent itemset to generate rules from
+ * @param itemset_len Length of frequent itemset
+ * @param itemset_supp Support of frequent itemset
+ * @param num_rules Number of rules generated at previous level
+ * @param min_conf Minimum confidence for valid rule
+ * @param freq_itemsets Set of frequent itemsets discovered
+ * @param rules Struct for holding rules as they are generated
+ * @param rule_len Length of previously generated rules
+ * @param prev_rules Pointer to beginning of rules generated at previous level of lattice
+ * @param work Scratch space and statistics shared by calls
+ */
+void fpt_gen_rules(
+    int * itemset,
+    int itemset_len,
+    int itemset_supp,
+    double min_conf,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_rules * rules,
+    int rule_len,
+    int num_rules,
+    int * prev_rules,
+    fpt_rule_work * work)
+{
+  if (itemset_len <= rule_len + 1) {
+    return;
+  }
+
+  fpt_dyn_array * cand_rules = work->cand_rules;
+  cand_rules->num_elements = 0;
+
+  /* Generate candidate rules */
+  /* First handle generation of rules of length 1 */
+  if (rule_len == 0) {
+    fpt_dyn_array_add_values(cand_rules, itemset, itemset_len);
+  }
+
+  /* Consequents are in lexicographic order, so those sharing a prefix are adjacent */
+  for (int i=0; i<num_rules; i++) {
+    for (int j=i+1; j<num_rules; j++) {
+      if (memcmp(&prev_rules[i*rule_len], &prev_rules[j*rule_len], (rule_len-1)*sizeof(*prev_rules)) != 0) {
+        break;
+      }
+      fpt_dyn_array_add_values(cand_rules, &prev_rules[i*rule_len], rule_len);
+      fpt_dyn_array_add(cand_rules, prev_rules[(j+1)*rule_len - 1]);
+    }
+  }
+
+  int num_cands = cand_rules->num_elements/(rule_len+1);
+  if (num_cands == 0) {
+    return;
+  }
+
+  fpt_rule_stats_reserve(&work->stats, rule_len+1);
+  work->stats.generated[rule_len+1] += num_cands;
+
+  fpt_rule_work_reserve(&work->marker, &work->marker_capacity, num_cands);
+  fpt_rule_work_reserve(&work->lhs, &work->lhs_capacity, itemset_len);
+  int * marker = work->marker;
+  int * lhs = work->lhs;
+
+  /* Prune candidates. Dropping either of the last two items gives the consequents
+   * joined, so only subsets missing one of the first rule_len-1 items are looked up. */
+  if (rule_len >= 2) {
+    int num_slots = 2;
+    while (num_slots < 2 * num_rules) {
+      num_slots *= 2;
+    }
+    fpt_rule_work_reserve(&work->slots, &work->slots_capacity, num_slots);
+    memset(work->slots, 0xff, num_slots * sizeof(*work->slots));
+
+    unsigned int mask = num_slots - 1;
+    for (int k=0; k<num_rules; k++) {
+      unsigned int slot = fpt_hash_itemset(&prev_rules[k*rule_len], rule_len) & mask;
+      while (work->slots[slot] != -1) {
+        slot = (slot + 1) & mask;
+      }
+      work->slots[slot] = k;
+    }
+
+    for (int i=0; i<num_cands; i++) {
+      int * cand = &cand_rules->array[i*(rule_len+1)];
+      marker[i] = 1;
+
+      for (int skip=0; skip<rule_len-1 && marker[i]; skip++) {
+        memcpy(lhs, cand, skip * sizeof(*lhs));
+        memcpy(&lhs[skip], &cand[skip+1], (rule_len-skip) * sizeof(*lhs));
+        marker[i] = fpt_rule_work_contains(work, num_slots, prev_rules, rule_len, lhs);
+      }
+
+      if (!marker[i]) {
+        work->stats.pruned[rule_len+1]++;
+      }
+    }
+  }
+  else {
+    for (int i=0; i<num_cands; i++) {
+      marker[i] = 1;
+    }
+  }
+
+  /* Check confidence of remaining rules */
+  int num_new_rules = 0;
+  int total_prev_elements = rules->rhs->num_elements;    /* Need to keep the number of rules instead of a pointer in case dynamic array is expanded */
+  for (int i=0; i<num_cands; i++) {
+    if (marker[i] == 1) {
+
+      fpt_rule_lhs(itemset, itemset_len, &cand_rules->array[i * (rule_len+1)], rule_len+1, lhs);
+
+      int supp = fpt_lookup_support(lhs, itemset_len-(rule_len+1), freq_itemsets);
+
+      double conf = itemset_supp / ( (double) supp);
+
+      if (conf > min_conf) {
+        /* Add LHS of rule to set of rules */
+        fpt_dyn_array_add_values(rules->lhs, lhs, itemset_len-(rule_len+1));
+        fpt_dyn_array_add(rules->lhs_idx, rules->lhs_idx->array[rules->lhs_idx->num_elements-1] + itemset_len-(rule_len+1));
+
+        /* Add RHS of rule to set of rules */
+        fpt_dyn_array_add_values(rules->rhs, &cand_rules->array[i*(rule_len+1)], rule_len+1);
+        fpt_dyn_array_add(rules->rhs_idx, rules->rhs_idx->array[rules->rhs_idx->num_elements-1] + rule_len+1);
+
+        /* Add support and confidence to set of rules */
+        fpt_dyn_array_add(rules->supp, itemset_supp);
+        fpt_dyn_array_dbl_add(rules->conf, conf);
+
+        num_new_rules++;
+      }
+    }
+  }
+  work->stats.accepted[rule_len+1] += num_new_rules;
+
+  /* Scratch space is free again, so the next length reuses it */
+  fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, rules, rule_len+1, num_new_rules, &rules->rhs->array[total_prev_elements], work);
+}
+
+/*
+ * @brief Generate rules from all frequent itemsets
+ *
+ * @param freq_itemsets Set of all frequent itemsets
+ * @param rules Struct to hold rules as they are generated
+ * @param min_conf Minimum confidence level for valid rules
+ * @param stats Candidate counts are added here (NULL to skip)
+ */
+void fpt_gen_all_rules(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_rules * rules,
+    double min_conf,
+    fpt_rule_stats * stats)
+{
+  int * buf = (freq_itemsets->trie != NULL) ? malloc(freq_itemsets->trie->max_len * sizeof(*buf)) : NULL;
+  fpt_rule_work * work = fpt_rule_work_init();
+
+  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
+    int itemset_len;
+    int * itemset = fpt_freq_itemsets_get(freq_itemsets, i, buf, &itemset_len);
+    int itemset_supp = freq_itemsets->supports->array[i];
+    fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, rules, 0, 0, rules->rhs->array, work);
+  }
+
+  if (stats != NULL) {
+    fpt_rule_stats_add(stats, &work->stats);
+  }
+  fpt_rule_work_free(work);
+  free(buf);
+}
+
+/*
+ * @brief Generate rules from all frequent itemsets in parallel. Threads take
+ *        chunks of itemsets and keep their own rules, which are concatenated
+ *        in chunk order so the result matches serial generation.
+ *
+ * @param freq_itemsets Set of all frequent itemsets
+ * @param rules Struct to hold rules as they are generated
+ * @param min_conf Minimum confidence level for valid rules
+ * @param stats Candidate counts are added here (NULL to skip)
+ */
+void fpt_gen_all_rules_parallel(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_rules * rules,
+    double min_conf,
+    fpt_rule_stats * stats)
+{
+  int num_itemsets = freq_itemsets->supports->num_elements;
+  int num_chunks = (num_itemsets + RULE_CHUNK_SIZE - 1) / RULE_CHUNK_SIZE;
+  int num_threads = omp_get_max_threads();
+
+  fpt_rules ** thread_rules = malloc(num_threads * sizeof(*thread_rules));
+  int * chunk_thread = malloc(num_chunks * sizeof(*chunk_thread));
+  int * chunk_first = malloc(num_chunks * sizeof(*chunk_first));
+  int * chunk_last = malloc(num_chunks * sizeof(*chunk_last));
+
+  #pragma omp parallel
+  {
+    int tid = omp_get_thread_num();
+    fpt_rules * local_rules = fpt_rules_init();
+    thread_rules[tid] = local_rules;
+    int * buf = (freq_itemsets->trie != NULL) ? malloc(freq_itemsets->trie->max_len * sizeof(*buf)) : NULL;
+    fpt_rule_work * work = fpt_rule_work_init();
+
+    #pragma omp for schedule(dynamic, 1)
+    for (int c=0; c<num_chunks; c++) {
+      chunk_thread[c] = tid;
+      chunk_first[c] = local_rules->supp->num_elements;
+
+      int last = (c+1) * RULE_CHUNK_SIZE < num_itemsets ? (c+1) * RULE_CHUNK_SIZE : num_itemsets;
+      for (int i=c*RULE_CHUNK_SIZE; i<last; i++) {
+        int itemset_len;
+        int * itemset = fpt_freq_itemsets_get(freq_itemsets, i, buf, &itemset_len);
+        int itemset_supp = freq_itemsets->supports->array[i];
+        fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, local_rules, 0, 0, local_rules->rhs->array, work);
+      }
+
+      chunk_last[c] = local_rules->supp->num_elements;
+    }
+
+    if (stats != NULL) {
+      #pragma omp critical
+      fpt_rule_stats_add(stats, &work->stats);
+    }
+    fpt_rule_work_free(work);
+    free(buf);
+  }
+
+  for (int c=0; c<num_chunks; c++) {
+    fpt_rules_append(rules, thread_rules[chunk_thread[c]], chunk_first[c], chunk_last[c]);
+  }
+
+  for (int i=0; i<num_threads; i++) {
+    fpt_rules_free(thread_rules[i]);
+  }
+  free(thread_rules);
+  free(chunk_thread);
+  free(chunk_first);
+  free(chunk_last);
+}
+
+/*
+ * @brief Create rules with empty RHS's (for use with small min_supp values)
+ *
+ * @param freq_itemsets Set of all frequent itemsets
+ * @param rules Struct to hold rules
+ */
+void fpt_create_empty_rules(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_rules * rules)
+{
+  int * buf = (freq_itemsets->trie != NULL) ? malloc(freq_itemsets->trie->max_len * sizeof(*buf)) : NULL;
+
+  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
+    int itemset_len;
+    int * itemset = fpt_freq_itemsets_get(freq_itemsets, i, buf, &itemset_len);
+
+    fpt_dyn_array_add_values(rules->lhs, itemset, itemset_len);
+    fpt_dyn_array_add(rules->lhs_idx, rules->lhs_idx->array[rules->lhs_idx->num_elements-1] + itemset_len);
+
+    fpt_dyn_array_add(rules->rhs_idx, 0);
+
+    fpt_dyn_array_add(rules->supp, freq_itemsets->supports->array[i]);
+    fpt_dyn_array_dbl_add(rules->conf, -1);
+  }
+
+  free(buf);
+}
+
+/*
+ * @brief Read datafile
+ *
+ * @param fname Name of file to read
+ */
+fpt_dyn_csr * read_file(
+    char const * const fname)
+{
+  /* Open file */
+  FILE * fin;
+  if((fin = fopen(fname, "r")) == NULL) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  fpt_dyn_csr * csr = fpt_dyn_csr_init();
+
+  int num_items = 0;
+  int prev_trans_id = 0;
+
+  char * line = malloc(1024 * 1024);
+  size_t len = 0;
+  ssize_t read = getline(&line, &len, fin);
+
+  while (read >= 0) {
+
+    char * ptr = strtok(line, " ");
+    char * end = NULL;
+
+    int trans_id = strtoull(ptr, &end, 10);
+    if (trans_id > prev_trans_id) {
+      prev_trans_id = trans_id;
+      fpt_dyn_array_add(csr->row_idx, num_items);
+    }
+
+    ptr = strtok(NULL, " ");
+    end = NULL;
+    int item = strtoull(ptr, &end, 10);
+    if (item > csr->max_val) {
+      csr->max_val = item;
+    }
+    fpt_dyn_array_add(csr->val, item);
+
+    num_items++;
+
+    read = getline(&line, &len, fin);
+  }
+
+  fpt_dyn_array_add(csr->row_idx, num_items);
+
+  fclose(fin);
+
+  free(line);
+
+  return csr;
+
+}
+
+/*
+ * @brief Parse an unsigned decimal integer
+ *
+ * @param ptr Position in text, moved past the number
+ * @param end End of text
+ *
+ * @return Value parsed (0 if no digits)
+ */
+static inline int fpt_parse_int(
+    char const ** ptr,
+    char const * end)
+{
+  char const * p = *ptr;
+  int val = 0;
+
+  while (p < end && *p >= '0' && *p <= '9') {
+    val = 10 * val + (*p - '0');
+    p++;
+  }
+
+  *ptr = p;
+
+  return val;
+}
+
+/*
+ * @brief Parse "trans_id item" lines of a mapped file. Rows are started
+ *        whenever a transaction ID is larger than all earlier ones in the
+ *        chunk; whether that holds for the whole file is decided when chunks
+ *        are merged.
+ *
+ * @param ptr Start of chunk (beginning of a line)
+ * @param end End of chunk (just past a newline or end of file)
+ * @param vals Items found
+ * @param row_starts Offsets into vals where candidate rows start
+ * @param row_IDs Transaction IDs of candidate rows
+ * @param max_ID Largest transaction ID in chunk (-1 if none)
+ * @param max_val Largest item in chunk
+ */
+void fpt_parse_chunk(
+    char const * ptr,
+    char const * end,
+    fpt_dyn_array * vals,
+    fpt_dyn_array * row_starts,
+    fpt_dyn_array * row_IDs,
+    int * max_ID,
+    int * max_val)
+{
+  int prev_trans_id = -1;
+  int max_item = 0;
+
+  while (ptr < end) {
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r')) {
+      ptr++;
+    }
+
+    if (ptr < end && *ptr != '\n') {
+      int trans_id = fpt_parse_int(&ptr, end);
+      if (trans_id > prev_trans_id) {
+        prev_trans_id = trans_id;
+        fpt_dyn_array_add(row_starts, vals->num_elements);
+        fpt_dyn_array_add(row_IDs, trans_id);
+      }
+
+      while (ptr < end && (*ptr == ' ' || *ptr == '\t')) {
+        ptr++;
+      }
+
+      int item = fpt_parse_int(&ptr, end);
+      if (item > max_item) {
+        max_item = item;
+      }
+      fpt_dyn_array_add(vals, item);
+    }
+
+    /* Skip rest of line */
+    while (ptr < end && *ptr != '\n') {
+      ptr++;
+    }
+    ptr++;
+  }
+
+  *max_ID = prev_trans_id;
+  *max_val = max_item;
+}
+
+/*
+ * @brief Read transactions from file by mapping it into memory. The file is
+ *        cut into one chunk per thread at line boundaries and chunks are
+ *        parsed in parallel, then concatenated.
+ *
+ * @param fname Name of input file
+ *
+ * @return CSR holding transactions (same as read_file)
+ */
+fpt_dyn_csr * fpt_mmap_read_file(
+    char const * const fname)
+{
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  char const * data = NULL;
+  if (size > 0) {
+    data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      fprintf(stderr, "unable to map '%s'.\n", fname);
+      exit(EXIT_FAILURE);
+    }
+    posix_madvise((void *) data, size, POSIX_MADV_SEQUENTIAL);
+  }
+
+  int num_chunks = omp_get_max_threads();
+  if ((size_t) num_chunks > size / LOAD_CHUNK_MIN_SIZE) {
+    num_chunks = size / LOAD_CHUNK_MIN_SIZE;
+  }
+  if (num_chunks < 1) {
+    num_chunks = 1;
+  }
+
+  /* Move chunk boundaries forward to the start of the next line */
+  size_t * bounds = malloc((num_chunks+1) * sizeof(*bounds));
+  bounds[0] = 0;
+  for (int t=1; t<num_chunks; t++) {
+    size_t pos = size / num_chunks * t;
+    if (pos < bounds[t-1]) {
+      pos = bounds[t-1];
+    }
+    while (pos < size && data[pos-1] != '\n') {
+      pos++;
+    }
+    bounds[t] = pos;
+  }
+  bounds[num_chunks] = size;
+
+  fpt_dyn_array ** vals = malloc(num_chunks * sizeof(*vals));
+  fpt_dyn_array ** row_starts = malloc(num_chunks * sizeof(*row_starts));
+  fpt_dyn_array ** row_IDs = malloc(num_chunks * sizeof(*row_IDs));
+  int * max_IDs = malloc(num_chunks * sizeof(*max_IDs));
+  int * max_vals = malloc(num_chunks * sizeof(*max_vals));
+
+  #pragma omp parallel for schedule(static, 1)
+  for (int t=0; t<num_chunks; t++) {
+    vals[t] = fpt_dyn_array_malloc();
+    row_starts[t] = fpt_dyn_array_malloc();
+    row_IDs[t] = fpt_dyn_array_malloc();
+    fpt_parse_chunk(data + bounds[t], data + bounds[t+1], vals[t], row_starts[t], row_IDs[t], &max_IDs[t], &max_vals[t]);
+  }
+
+  fpt_dyn_csr * csr = fpt_dyn_csr_init();
+
+  /* A candidate row really starts a transaction if its ID is also larger than
+   * every ID in earlier chunks (read_file starts comparing against 0) */
+  int prev_trans_id = 0;
+  int num_items = 0;
+  int * offsets = malloc(num_chunks * sizeof(*offsets));
+  for (int t=0; t<num_chunks; t++) {
+    for (int i=0; i<row_starts[t]->num_elements; i++) {
+      if (row_IDs[t]->array[i] > prev_trans_id) {
+        fpt_dyn_array_add(csr->row_idx, num_items + row_starts[t]->array[i]);
+      }
+    }
+    if (max_IDs[t] > prev_trans_id) {
+      prev_trans_id = max_IDs[t];
+    }
+    if (max_vals[t] > csr->max_val) {
+      csr->max_val = max_vals[t];
+    }
+    offsets[t] = num_items;
+    num_items += vals[t]->num_elements;
+  }
+  fpt_dyn_array_add(csr->row_idx, num_items);
+
+  if (num_items > csr->val->capacity) {
+    free(csr->val->array);
+    csr->val->array = malloc(num_items * sizeof(*csr->val->array));
+    csr->val->capacity = num_items;
+  }
+  csr->val->num_elements = num_items;
+
+  #pragma omp parallel for schedule(static, 1)
+  for (int t=0; t<num_chunks; t++) {
+    memcpy(csr->val->array + offsets[t], vals[t]->array, vals[t]->num_elements * sizeof(*vals[t]->array));
+    fpt_dyn_array_free(vals[t]);
+    fpt_dyn_array_free(row_starts[t]);
+    fpt_dyn_array_free(row_IDs[t]);
+  }
+
+  if (size > 0) {
+    munmap((void *) data, size);
+  }
+  close(fd);
+
+  free(bounds);
+  free(vals);
+  free(row_starts);
+  free(row_IDs);
+  free(max_IDs);
+  free(max_vals);
+  free(offsets);
+
+  return csr;
+}
+
+/*
+ * @brief Write transactions and item relabeling to a binary cache file
+ *
+ * @param fname Name of cache file
+ * @param ifname Name of text file transactions were read from
+ * @param csr Transactions
+ * @param item_counts Count of each item
+ * @param forward_map Map from original item IDs to sorted IDs
+ * @param backward_map Map from sorted item IDs to original IDs
+ *
+ * @return 0 on success, -1 if the file could not be written
+ */
+int fpt_write_cache(
+    char const * const fname,
+    char const * const ifname,
+    fpt_dyn_csr * csr,
+    int * item_counts,
+    int * forward_map,
+    int * backward_map)
+{
+  struct stat st;
+  char * path;
+  if (stat(ifname, &st) != 0 || (path = realpath(ifname, NULL)) == NULL) {
+    return -1;
+  }
+
+  fpt_cache_header header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "FPTC", 4);
+  header.version = CACHE_VERSION;
+  header.nrows = csr->row_idx->num_elements - 1;
+  header.nnz = csr->val->num_elements;
+  header.max_val = csr->max_val;
+  header.source_size = st.st_size;
+  header.source_mtime = st.st_mtime;
+  header.path_len = strlen(path);
+
+  FILE * fout;
+  if ((fout = fopen(fname, "wb")) == NULL) {
+    free(path);
+    return -1;
+  }
+
+  char padding[8] = {0};
+  fwrite(&header, sizeof(header), 1, fout);
+  fwrite(path, 1, header.path_len, fout);
+  fwrite(padding, 1, ((header.path_len + 7) & ~7) - header.path_len, fout);
+  free(path);
+  fwrite(csr->row_idx->array, sizeof(int), header.nrows + 1, fout);
+  fwrite(csr->val->array, sizeof(int), header.nnz, fout);
+  fwrite(item_counts, sizeof(int), header.max_val, fout);
+  fwrite(forward_map, sizeof(int), header.max_val, fout);
+  fwrite(backward_map, sizeof(int), header.max_val, fout);
+
+  if (ferror(fout)) {
+    fclose(fout);
+    return -1;
+  }
+
+  fclose(fout);
+
+  return 0;
+}
+
+/*
+ * @brief Map a binary cache file. The cache is only used if it was built
+ *        from the current version of the same text file (same absolute path,
+ *        size and modification time).
+ *
+ * @param fname Name of cache file
+ * @param ifname Name of text file transactions are read from
+ *
+ * @return Loaded cache, or NULL if missing, invalid or out of date
+ */
+fpt_cache * fpt_open_cache(
+    char const * const fname,
+    char const * const ifname)
+{
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    return NULL;
+  }
+
+  struct stat st;
+  struct stat source_st;
+  char * path;
+  fstat(fd, &st);
+  if (stat(ifname, &source_st) != 0 || (size_t) st.st_size < sizeof(fpt_cache_header) ||
+      (path = realpath(ifname, NULL)) == NULL) {
+    close(fd);
+    return NULL;
+  }
+
+  void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    free(path);
+    return NULL;
+  }
+
+  fpt_cache_header * header = data;
+  size_t path_bytes = ((size_t) header->path_len + 7) & ~(size_t) 7;
+  size_t expected_size = sizeof(*header) + path_bytes +
+    ((size_t) header->nrows + 1 + header->nnz + 3 * (size_t) header->max_val) * sizeof(int);
+
+  if (memcmp(header->magic, "FPTC", 4) || header->version != CACHE_VERSION ||
+      header->path_len < 0 || (size_t) st.st_size != expected_size ||
+      header->source_size != source_st.st_size || header->source_mtime != source_st.st_mtime ||
+      (size_t) header->path_len != strlen(path) || memcmp(header + 1, path, header->path_len) != 0) {
+    munmap(data, st.st_size);
+    free(path);
+    return NULL;
+  }
+  free(path);
+
+  fpt_cache * cache = malloc(sizeof(*cache));
+  cache->data = data;
+  cache->size = st.st_size;
+
+  int * arrays = (int *) ((char *) (header + 1) + path_bytes);
+
+  cache->row_idx.array = arrays;
+  cache->row_idx.num_elements = header->nrows + 1;
+  cache->row_idx.capacity = cache->row_idx.num_elements;
+  arrays += header->nrows + 1;
+
+  cache->val.array = arrays;
+  cache->val.num_elements = header->nnz;
+  cache->val.capacity = header->nnz;
+  arrays += header->nnz;
+
+  cache->csr.row_idx = &cache->row_idx;
+  cache->csr.val = &cache->val;
+  cache->csr.max_val = header->max_val;
+
+  cache->item_counts = arrays;
+  cache->forward_map = arrays + header->max_val;
+  cache->backward_map = arrays + 2 * header->max_val;
+
+  return cache;
+}
+
+/*
+ * @brief Unmap a cache file
+ *
+ * @param cache Cache to close
+ */
+void fpt_close_cache(
+    fpt_cache * cache)
+{
+  munmap(cache->data, cache->size);
+  free(cache);
+}
+
+/*
+ * @brief Write rules to an open file
+ *
+ * @param fout File to write to
+ * @param rules Struct holding rules generated
+ * @param map Transforms item IDs back to original IDs
+ */
+void fpt_write_rules(
+    FILE * fout,
+    fpt_rules * rules,
+    int * map)
+{
+  for (int i=0; i<rules->supp->num_elements; i++) {
+    for (int j=rules->lhs_idx->array[i]; j<rules->lhs_idx->array[i+1]; j++) {
+      fprintf(fout, "%d ", map[rules->lhs->array[j]-1]);
+    }
+    fprintf(fout, "| ");
+    if ((rules->rhs_idx->array[i+1] - rules->rhs_idx->array[i]) == 0) {
+      fprintf(fout, "{} ");
+    }
+    else {
+      for (int j=rules->rhs_idx->array[i]; j<rules->rhs_idx->array[i+1]; j++) {
+        fprintf(fout, "%d ", map[rules->rhs->array[j]-1]);
+      }
+    }
+    if (rules->conf->array[i] == -1) {
+      fprintf(fout, "| %d | %0.0f\n", rules->supp->array[i], rules->conf->array[i]);
+    }
+    else {
+      fprintf(fout, "| %d | %0.04f\n", rules->supp->array[i], rules->conf->array[i]);
+    }
+  }
+}
+
+/*
+ * @brief Write rules to output file
+ *
+ * @param rules Struct holding rules generated
+ * @param ofname Name of output file
+ * @param map Transforms item IDs back to original IDs
+ */
+void fpt_write_rules_to_file(
+    fpt_rules * rules,
+    char * ofname,
+    int * map)
+{
+  FILE * fout = fopen(ofname, "w");
+
+  fpt_write_rules(fout, rules, map);
+
+  fclose(fout);
+}
+
+/*
+ * @brief Number of bytes occupied by the rules currently held
+ *
+ * @param rules Set of rules
+ *
+ * @return Bytes used by rules
+ */
+size_t fpt_rules_bytes(
+    fpt_rules * rules)
+{
+  return (size_t) (rules->lhs->num_elements + rules->lhs_idx->num_elements + rules->rhs->num_elements +
+      rules->rhs_idx->num_elements + rules->supp->num_elements) * sizeof(int) +
+    (size_t) rules->conf->num_elements * sizeof(double);
+}
+
+/*
+ * @brief Write held rules to a file (if any) and empty set of rules. Space
+ *        already allocated is kept for the next chunk.
+ *
+ * @param rules Set of rules
+ * @param fout File to write to (NULL to discard rules)
+ * @param map Transforms item IDs back to original IDs
+ */
+void fpt_rules_flush(
+    fpt_rules * rules,
+    FILE * fout,
+    int * map)
+{
+  if (fout != NULL) {
+    fpt_write_rules(fout, rules, map);
+  }
+
+  rules->lhs->num_elements = 0;
+  rules->lhs_idx->num_elements = 1;
+  rules->rhs->num_elements = 0;
+  rules->rhs_idx->num_elements = 1;
+  rules->supp->num_elements = 0;
+  rules->conf->num_elements = 0;
+}
+
+/*
+ * @brief Generate rules from all frequent itemsets, writing them out in chunks
+ *        to keep held rules near a memory limit. Rules are flushed between
+ *        itemsets once they use half the limit, which leaves room for the
+ *        dynamic arrays to double. The limit is approximate: the rules of one
+ *        itemset are generated from each other and are always held together,
+ *        so a single itemset with very many rules can exceed it. With several
+ *        threads each thread gets an equal share of the limit and chunks are
+ *        written in completion order.
+ *
+ * @param freq_itemsets Set of all frequent itemsets
+ * @param min_conf Minimum confidence level for valid rules
+ * @param max_bytes Memory limit for held rules
+ * @param fout File to write rules to (NULL to only count rules)
+ * @param map Transforms item IDs back to original IDs
+ * @param stats Candidate counts are added here (NULL to skip)
+ *
+ * @return Number of rules generated
+ */
+long fpt_gen_all_rules_streaming(
+    fpt_freq_itemsets * freq_itemsets,
+    double min_conf,
+    size_t max_bytes,
+    FILE * fout,
+    int * map,
+    fpt_rule_stats * stats)
+{
+  long num_rules = 0;
+  int num_itemsets = freq_itemsets->supports->num_elements;
+
+  #pragma omp parallel reduction(+: num_rules)
+  {
+    fpt_rules * rules = fpt_rules_init();
+    size_t flush_bytes = max_bytes / (2 * omp_get_num_threads());
+    fpt_rule_work * work = fpt_rule_work_init();
+
+    #pragma omp for schedule(dynamic, RULE_CHUNK_SIZE)
+    for (int i=0; i<num_itemsets; i++) {
+      int * itemset = &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[i]];
+      int itemset_len = freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i];
+      int itemset_supp = freq_itemsets->supports->array[i];
+      fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, rules, 0, 0, rules->rhs->array, work);
+
+      if (fpt_rules_bytes(rules) >= flush_bytes) {
+        num_rules += rules->supp->num_elements;
+        #pragma omp critical
+        fpt_rules_flush(rules, fout, map);
+      }
+    }
+
+    num_rules += rules->supp->num_elements;
+    #pragma omp critical
+    fpt_rules_flush(rules, fout, map);
+
+    if (stats != NULL) {
+      #pragma omp critical
+      fpt_rule_stats_add(stats, &work->stats);
+    }
+    fpt_rule_work_free(work);
+    fpt_rules_free(rules);
+  }
+
+  return num_rules;
+}
+
+/*
+ * @brief Keep only the itemsets meeting a higher support. The result stays in
+ *        the order itemsets were found, so support lookups still work.
+ *
+ * @param freq_itemsets Set of frequent itemsets
+ * @param min_supp Minimum support count of itemsets kept
+ *
+ * @return New set holding itemsets with support at least min_supp
+ */
+fpt_freq_itemsets * fpt_filter_freq_itemsets(
+    fpt_freq_itemsets * freq_itemsets,
+    int min_supp)
+{
+  fpt_freq_itemsets * filtered = fpt_freq_itemsets_init();
+
+  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
+    if (freq_itemsets->supports->array[i] >= min_supp) {
+      fpt_freq_itemsets_append(filtered, freq_itemsets, i, i+1);
+    }
+  }
+
+  return filtered;
+}
+
+/*
+ * @brief Initialize top-k state
+ *
+ * @param k Number of itemsets wanted
+ * @param min_len Minimum length of itemsets counted towards k
+ * @param min_supp Lowest support threshold allowed
+ *
+ * @return Allocated top-k state
+ */
+fpt_topk * fpt_topk_init(
+    int k,
+    int min_len,
+    int min_supp)
+{
+  fpt_topk * topk = malloc(sizeof(*topk));
+
+  topk->k = k;
+  topk->min_len = min_len;
+  topk->heap = malloc(k * sizeof(*topk->heap));
+  topk->heap_size = 0;
+  topk->min_freq = min_supp;
+
+  return topk;
+}
+
+/*
+ * @brief Free top-k state
+ *
+ * @param topk Top-k state to free
+ */
+void fpt_topk_free(
+    fpt_topk * topk)
+{
+  free(topk->heap);
+  free(topk);
+}
+
+/*
+ * @brief Record support of a new itemset. Once k itemsets are held the
+ *        threshold is raised to the smallest support among them.
+ *
+ * @param topk Top-k state
+ * @param len Length of itemset
+ * @param supp Support of itemset
+ */
+void fpt_topk_add(
+    fpt_topk * topk,
+    int len,
+    int supp)
+{
+  if (len < topk->min_len) {
+    return;
+  }
+
+  int * heap = topk->heap;
+  int pos;
+
+  if (topk->heap_size < topk->k) {
+    /* Sift new support up */
+    pos = topk->heap_size++;
+    while (pos > 0 && heap[(pos-1)/2] > supp) {
+      heap[pos] = heap[(pos-1)/2];
+      pos = (pos-1)/2;
+    }
+    heap[pos] = supp;
+  }
+  else if (supp > heap[0]) {
+    /* Replace smallest support and sift it down */
+    pos = 0;
+    while (2*pos+1 < topk->heap_size) {
+      int child = 2*pos+1;
+      if (child+1 < topk->heap_size && heap[child+1] < heap[child]) {
+        child++;
+      }
+      if (heap[child] >= supp) {
+        break;
+      }
+      heap[pos] = heap[child];
+      pos = child;
+    }
+    heap[pos] = supp;
+  }
+
+  if (topk->heap_size == topk->k && heap[0] > topk->min_freq) {
+    topk->min_freq = heap[0];
+  }
+}
+
+/*
+ * @brief Find the k most frequent itemsets. Items are visited from most to
+ *        least frequent so the threshold rises early, and every conditional
+ *        tree is built with the threshold current at the time. Itemsets
+ *        found before the threshold rose are dropped later.
+ *
+ * @param tree Pointer to root of FP tree
+ * @param topk Top-k state holding current threshold
+ * @param suffix Current suffix
+ * @param suff_len Current suffix length
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ */
+void fpt_find_topk_itemsets(
+    fpt_node * tree,
+    fpt_topk * topk,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas)
+{
+  for (int i=1; i<=tree->max_item_ID; i++) {
+    if (tree->item_array[i-1] == NULL) {
+      continue;
+    }
+
+    int count = fpt_count_item(tree->item_array[i-1]);
+    if (count < topk->min_freq) {
+      continue;
+    }
+
+    *(suffix-suff_len-1) = i;
+    int len = suff_len + 1;
+
+    fpt_freq_itemsets_add(freq_itemsets, &suffix[-len], len, count);
+    fpt_topk_add(topk, len, count);
+
+    fpt_node * cond_tree = fpt_create_conditional_tree(tree, i, topk->min_freq, arenas[len]);
+    fpt_find_topk_itemsets(cond_tree, topk, suffix, len, freq_itemsets, arenas);
+
+    fpt_arena_reset(arenas[len]);
+
+    /* Drop itemsets that fell below the threshold once they outnumber the ones kept */
+    if (suff_len == 0 && freq_itemsets->supports->num_elements > 2 * topk->k) {
+      fpt_freq_itemsets * kept = fpt_filter_freq_itemsets(freq_itemsets, topk->min_freq);
+      fpt_freq_itemsets_swap(freq_itemsets, kept);
+      fpt_freq_itemsets_free(kept);
+    }
+  }
+}
+
+/*
+ * @brief Comparison operator putting itemsets in the order
+ *        fpt_find_frequent_itemsets finds them (used by fpt_search_support)
+ *
+ * @param a Pointer to first fpt_itemset_ref
+ * @param b Pointer to second fpt_itemset_ref
+ */
+int fpt_itemset_ref_comp(
+    const void * a,
+    const void * b)
+{
+  const fpt_itemset_ref * x = a;
+  const fpt_itemset_ref * y = b;
+
+  /* Compare from largest item down; larger items and shorter itemsets come first */
+  for (int t=1; t<=x->len && t<=y->len; t++) {
+    if (x->items[x->len-t] != y->items[y->len-t]) {
+      return (x->items[x->len-t] > y->items[y->len-t]) ? -1 : 1;
+    }
+  }
+
+  return x->len - y->len;
+}
+
+/*
+ * @brief Keep the itemsets reaching a support threshold and a minimum length,
+ *        in the order fpt_find_frequent_itemsets finds them
+ *
+ * @param freq_itemsets Itemsets in any order
+ * @param min_freq Minimum support of kept itemsets
+ * @param min_len Minimum length of kept itemsets
+ *
+ * @return New set of itemsets
+ */
+fpt_freq_itemsets * fpt_select_freq_itemsets(
+    fpt_freq_itemsets * freq_itemsets,
+    int min_freq,
+    int min_len)
+{
+  int num_itemsets = freq_itemsets->supports->num_elements;
+  fpt_itemset_ref * refs = malloc(num_itemsets * sizeof(*refs));
+
+  int num_kept = 0;
+  for (int i=0; i<num_itemsets; i++) {
+    int len = freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i];
+    if (freq_itemsets->supports->array[i] >= min_freq && len >= min_len) {
+      refs[num_kept].items = &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[i]];
+      refs[num_kept].len = len;
+      refs[num_kept].supp = freq_itemsets->supports->array[i];
+      num_kept++;
+    }
+  }
+
+  qsort(refs, num_kept, sizeof(*refs), fpt_itemset_ref_comp);
+
+  fpt_freq_itemsets * kept = fpt_freq_itemsets_init();
+  for (int i=0; i<num_kept; i++) {
+    fpt_freq_itemsets_add(kept, refs[i].items, refs[i].len, refs[i].supp);
+  }
+
+  free(refs);
+
+  return kept;
+}
+
+/*
+ * @brief Keep the itemsets reaching the final top-k threshold and the
+ *        minimum length, in the order fpt_find_frequent_itemsets finds them
+ *
+ * @param freq_itemsets Itemsets found by fpt_find_topk_itemsets
+ * @param topk Top-k state after mining
+ *
+ * @return New set of itemsets
+ */
+fpt_freq_itemsets * fpt_topk_finish(
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_topk * topk)
+{
+  return fpt_select_freq_itemsets(freq_itemsets, topk->min_freq, topk->min_len);
+}
+
+/*
+ * @brief Map a transaction file for one pass of partitioned mining
+ *
+ * @param fd Descriptor of open file
+ * @param size Size of file
+ *
+ * @return Start of mapping (NULL if file is empty)
+ */
+char const * fpt_son_map(
+    int fd,
+    size_t size)
+{
+  if (size == 0) {
+    return NULL;
+  }
+
+  char const * data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    fprintf(stderr, "unable to map transaction file.\n");
+    exit(EXIT_FAILURE);
+  }
+  posix_madvise((void *) data, size, POSIX_MADV_SEQUENTIAL);
+
+  return data;
+}
+
+/*
+ * @brief Unmap the pages of a mapped file before a position, so a pass holds
+ *        only the partition it is working on
+ *
+ * @param data Start of mapping
+ * @param size Size of mapping
+ * @param released Number of bytes already unmapped (updated)
+ * @param pos Position everything before is done with (size unmaps the rest)
+ */
+void fpt_son_release(
+    char const * data,
+    size_t size,
+    size_t * released,
+    size_t pos)
+{
+  if (pos < size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    pos = pos / page * page;
+  }
+
+  if (pos > *released) {
+    munmap((void *) (data + *released), pos - *released);
+    *released = pos;
+  }
+}
+
+/*
+ * @brief Find the end of a partition. The partition ends at the first line
+ *        at or after a target position that starts a new transaction, so the
+ *        lines of a transaction are never split between partitions.
+ *
+ * @param data Start of mapped file
+ * @param size Size of file
+ * @param start Start of partition
+ * @param target Wanted end of partition
+ *
+ * @return End of partition
+ */
+size_t fpt_son_partition_end(
+    char const * data,
+    size_t size,
+    size_t start,
+    size_t target)
+{
+  if (target >= size) {
+    return size;
+  }
+
+  size_t pos = (target > start) ? target : start + 1;
+  while (pos < size && data[pos-1] != '\n') {
+    pos++;
+  }
+
+  /* Transaction ID of the last line in the partition */
+  size_t line = pos - 1;
+  while (line > start && data[line-1] != '\n') {
+    line--;
+  }
+  char const * ptr = data + line;
+  while (ptr < data + size && (*ptr == ' ' || *ptr == '\t')) {
+    ptr++;
+  }
+  int prev_trans_id = fpt_parse_int(&ptr, data + size);
+
+  while (pos < size) {
+    ptr = data + pos;
+    while (ptr < data + size && (*ptr == ' ' || *ptr == '\t')) {
+      ptr++;
+    }
+    if (fpt_parse_int(&ptr, data + size) != prev_trans_id) {
+      break;
+    }
+
+    while (pos < size && data[pos] != '\n') {
+      pos++;
+    }
+    pos++;
+  }
+
+  return (pos < size) ? pos : size;
+}
+
+/*
+ * @brief Parse one partition of a mapped transaction file
+ *
+ * @param ptr Start of partition (beginning of a line)
+ * @param end End of partition
+ * @param max_val Largest item ID of whole file
+ *
+ * @return CSR holding transactions of partition
+ */
+fpt_dyn_csr * fpt_son_read_partition(
+    char const * ptr,
+    char const * end,
+    int max_val)
+{
+  fpt_dyn_csr * csr = malloc(sizeof(*csr));
+  csr->val = fpt_dyn_array_malloc();
+  csr->row_idx = fpt_dyn_array_malloc();
+
+  fpt_dyn_array * row_IDs = fpt_dyn_array_malloc();
+  int max_ID;
+  int part_max_val;
+  fpt_parse_chunk(ptr, end, csr->val, csr->row_idx, row_IDs, &max_ID, &part_max_val);
+  fpt_dyn_array_add(csr->row_idx, csr->val->num_elements);
+  fpt_dyn_array_free(row_IDs);
+
+  /* Item counts and maps are indexed by the IDs of the whole file */
+  csr->max_val = (max_val > part_max_val) ? max_val : part_max_val;
+
+  return csr;
+}
+
+/*
+ * @brief Count occurrences of each item in a transaction file one partition
+ *        at a time
+ *
+ * @param fname Name of transaction file
+ * @param max_bytes Memory budget for one partition (in bytes)
+ * @param max_val Largest item ID found
+ * @param num_trans Number of transactions found
+ *
+ * @return counts Array of counts for each item
+ */
+int * fpt_son_count_items(
+    char const * const fname,
+    size_t max_bytes,
+    int * max_val,
+    int * num_trans)
+{
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  /* A parsed item takes at most as many bytes as its line */
+  size_t part_bytes = max_bytes / (2 * sizeof(int));
+
+  int * counts = NULL;
+  *max_val = 0;
+  *num_trans = 0;
+
+  char const * data = fpt_son_map(fd, size);
+  size_t released = 0;
+
+  size_t end;
+  for (size_t start=0; start<size; start=end) {
+    end = fpt_son_partition_end(data, size, start, start + part_bytes);
+
+    fpt_dyn_csr * part = fpt_son_read_partition(data + start, data + end, *max_val);
+
+    if (part->max_val > *max_val) {
+      counts = realloc(counts, part->max_val * sizeof(*counts));
+      memset(counts + *max_val, 0, (part->max_val - *max_val) * sizeof(*counts));
+      *max_val = part->max_val;
+    }
+    for (int i=0; i<part->val->num_elements; i++) {
+      counts[part->val->array[i]-1] += 1;
+    }
+    *num_trans += part->row_idx->num_elements - 1;
+
+    fpt_dyn_csr_free(part);
+    fpt_son_release(data, size, &released, end);
+  }
+
+  fpt_son_release(data, size, &released, size);
+  close(fd);
+
+  if (counts == NULL) {
+    counts = calloc(1, sizeof(*counts));
+  }
+
+  return counts;
+}
+
+/*
+ * @brief Add one transaction to the counts of the candidates below a trie
+ *        node that it contains. A child extends its parent's candidate by one
+ *        item, so it is contained whenever its item is in the transaction.
+ *
+ * @param node Candidate trie node contained in transaction
+ * @param in_trans Flag for each item telling whether it is in transaction
+ */
+void fpt_son_count_candidates(
+    fpt_node * node,
+    const char * in_trans)
+{
+  for (fpt_node * child = node->child; child != NULL; child = child->next_sibling) {
+    if (in_trans[child->item-1]) {
+      #pragma omp atomic
+      child->count += 1;
+
+      fpt_son_count_candidates(child, in_trans);
+    }
+  }
+}
+
+/*
+ * @brief Collect the candidates below a trie node that reach a support
+ *
+ * @param node Candidate trie node
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param suffix Items on path to node (points one past last element)
+ * @param suff_len Length of path to node
+ * @param freq_itemsets Container for holding frequent itemsets
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_son_collect(
+    fpt_node * node,
+    int min_freq,
+    int * suffix,
+    int suff_len,
+    fpt_freq_itemsets * freq_itemsets,
+    const fpt_constraints * cons)
+{
+  for (fpt_node * child = node->child; child != NULL; child = child->next_sibling) {
+    /* Supersets of an infrequent candidate are infrequent too */
+    if (child->count >= min_freq) {
+      *(suffix-suff_len-1) = child->item;
+      /* The trie keeps every prefix of a candidate, including those
+       * without a required item */
+      if (fpt_has_required(cons, &suffix[-1 * (suff_len+1)], suff_len+1)) {
+        fpt_freq_itemsets_add(freq_itemsets, &suffix[-1 * (suff_len+1)], suff_len+1, child->count);
+      }
+      fpt_son_collect(child, min_freq, suffix, suff_len+1, freq_itemsets, cons);
+    }
+  }
+}
+
+/*
+ * @brief Find frequent itemsets with the two-pass partitioned (SON)
+ *        algorithm, reading the transaction file one partition at a time.
+ *        Pass one mines each partition at the support scaled to its share of
+ *        the transactions. A globally frequent itemset is locally frequent in
+ *        at least one partition, so the union of the local itemsets holds
+ *        every frequent itemset. Pass two counts these candidates over all
+ *        partitions.
+ *
+ * @param fname Name of transaction file
+ * @param max_bytes Memory budget for one partition (in bytes)
+ * @param item_counts Count of each item (in terms of original IDs)
+ * @param forward_map Map from original item IDs to sorted IDs
+ * @param max_val Largest original item ID
+ * @param num_trans Number of transactions in file
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param verbose Print statistics of each partition
+ * @param suffix Suffix buffer (points one past last element)
+ * @param arenas Arenas for each level of recursion (indexed by suffix length)
+ * @param cons Constraints on itemsets (NULL for none)
+ *
+ * @return Frequent itemsets in the order fpt_find_frequent_itemsets finds them
+ */
+fpt_freq_itemsets * fpt_son_find_frequent_itemsets(
+    char const * const fname,
+    size_t max_bytes,
+    const int * item_counts,
+    const int * forward_map,
+    int max_val,
+    int num_trans,
+    int min_freq,
+    int verbose,
+    int * suffix,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  /* Size partitions by the items they hold */
+  long nnz = 0;
+  int num_items = 0;
+  for (int i=0; i<max_val; i++) {
+    nnz += item_counts[i];
+    if (item_counts[i] >= min_freq) {
+      num_items++;
+    }
+  }
+  size_t part_bytes = size;
+  if (nnz > 0) {
+    part_bytes = (double) max_bytes / SON_BYTES_PER_ITEM * size / nnz;
+  }
+
+  /* Partitions of equal size, so none is mined at a much lower support than the others */
+  if (part_bytes > 0 && part_bytes < size) {
+    size_t num_parts = (size + part_bytes - 1) / part_bytes;
+    part_bytes = (size + num_parts - 1) / num_parts;
+  }
+
+  /* Candidates are stored from their largest item down, so every node of
+   * the trie is a candidate (local itemsets are closed under subsets) and
+   * itemsets found one after the other share a path */
+  fpt_arena * cand_arena = fpt_arena_init();
+  fpt_node * candidates = fpt_new_node(cand_arena);
+  candidates->root = candidates;
+  int * path = malloc((num_items + 1) * sizeof(*path));
+
+  /* Local itemsets are exact when the file is a single partition */
+  fpt_freq_itemsets * freq_itemsets = NULL;
+
+  double start_time = monotonic_seconds();
+
+  char const * data = fpt_son_map(fd, size);
+  size_t released = 0;
+  int num_parts = 0;
+
+  size_t end;
+  for (size_t start=0; start<size; start=end) {
+    end = fpt_son_partition_end(data, size, start, start + part_bytes);
+
+    fpt_dyn_csr * part = fpt_son_read_partition(data + start, data + end, max_val);
+    fpt_csr * trans = fpt_relabel_item_IDs(part, item_counts, forward_map, min_freq);
+    fpt_dyn_csr_free(part);
+    fpt_son_release(data, size, &released, end);
+
+    long local_freq = (num_trans > 0) ? (long) min_freq * trans->nrows / num_trans : 1;
+    if (local_freq < 2 && min_freq >= 2 && num_parts == 0) {
+      fprintf(stderr, "Partitions are mined at support 1; a larger memory budget (-P) avoids enumerating every subset\n");
+    }
+    if (local_freq < 1) {
+      local_freq = 1;
+    }
+
+    fpt_node * tree = fpt_create_fp_tree(trans, arenas[0]);
+    fpt_freq_itemsets * local_itemsets = fpt_freq_itemsets_init();
+
+    if (omp_get_max_threads() > 1) {
+      fpt_find_frequent_itemsets_parallel(tree, local_freq, local_itemsets, arenas, cons);
+    }
+    else {
+      fpt_find_frequent_itemsets(tree, local_freq, suffix, 0, local_itemsets, arenas, cons);
+    }
+
+    int num_local = local_itemsets->supports->num_elements;
+    if (verbose) {
+      printf("Partition %d: %d transactions, support %ld, %d local itemsets\n", num_parts, trans->nrows, local_freq, num_local);
+    }
+
+    if (start == 0 && end == size) {
+      freq_itemsets = local_itemsets;
+    }
+    else {
+      for (int i=0; i<num_local; i++) {
+        int * items = &local_itemsets->itemsets->array[local_itemsets->itemset_ind->array[i]];
+        int len = local_itemsets->itemset_ind->array[i+1] - local_itemsets->itemset_ind->array[i];
+        for (int j=0; j<len; j++) {
+          path[j] = items[len-j-1];
+        }
+        fpt_insert_path(candidates, path, len, 0, cand_arena);
+      }
+      fpt_freq_itemsets_free(local_itemsets);
+    }
+
+    fpt_free_csr(trans);
+    fpt_arena_reset(arenas[0]);
+    num_parts++;
+  }
+
+  fpt_son_release(data, size, &released, size);
+
+  if (verbose) {
+    printf("Partitioned pass one: %0.04f seconds, %d partitions of %zu bytes, %ld candidates\n",
+        monotonic_seconds()-start_time, num_parts, part_bytes, cand_arena->nodes_allocated - 1);
+  }
+
+  if (freq_itemsets == NULL) {
+    start_time = monotonic_seconds();
+
+    /* Largest items of candidates are looked up directly */
+    fpt_node ** heads = calloc(num_items + 1, sizeof(*heads));
+    for (fpt_node * child = candidates->child; child != NULL; child = child->next_sibling) {
+      heads[child->item-1] = child;
+    }
+
+    data = fpt_son_map(fd, size);
+    released = 0;
+
+    for (size_t start=0; start<size; start=end) {
+      end = fpt_son_partition_end(data, size, start, start + part_bytes);
+
+      fpt_dyn_csr * part = fpt_son_read_partition(data + start, data + end, max_val);
+      fpt_csr * trans = fpt_relabel_item_IDs(part, item_counts, forward_map, min_freq);
+      fpt_dyn_csr_free(part);
+      fpt_son_release(data, size, &released, end);
+
+      #pragma omp parallel
+      {
+        char * in_trans = calloc(num_items + 1, sizeof(*in_trans));
+
+        #pragma omp for schedule(dynamic, 256)
+        for (int i=0; i<trans->nrows; i++) {
+          int * items = &trans->val[trans->row_idx[i]];
+          int len = trans->row_idx[i+1] - trans->row_idx[i];
+
+          for (int j=0; j<len; j++) {
+            in_trans[items[j]-1] = 1;
+          }
+
+          for (int j=0; j<len; j++) {
+            fpt_node * head = heads[items[j]-1];
+            if (head != NULL) {
+              #pragma omp atomic
+              head->count += 1;
+
+              fpt_son_count_candidates(head, in_trans);
+            }
+          }
+
+          for (int j=0; j<len; j++) {
+            in_trans[items[j]-1] = 0;
+          }
+        }
+
+        free(in_trans);
+      }
+
+      fpt_free_csr(trans);
+    }
+
+    fpt_son_release(data, size, &released, size);
+
+    fpt_freq_itemsets * found = fpt_freq_itemsets_init();
+    fpt_son_collect(candidates, min_freq, path + num_items + 1, 0, found, cons);
+    freq_itemsets = fpt_select_freq_itemsets(found, min_freq, 1);
+
+    if (verbose) {
+      printf("Partitioned pass two: %0.04f seconds, %zu bytes of candidates\n",
+          monotonic_seconds()-start_time, cand_arena->bytes_allocated);
+    }
+
+    fpt_freq_itemsets_free(found);
+    free(heads);
+  }
+
+  close(fd);
+
+  free(path);
+  fpt_arena_free(cand_arena);
+
+  return freq_itemsets;
+}
+
+#ifdef FPT_MPI
+/*
+ * @brief Read the share of a transaction file belonging to one MPI rank. The
+ *        file is cut into one piece per rank at transaction boundaries.
+ *
+ * @param fname Name of transaction file
+ * @param rank Rank of calling process
+ * @param num_ranks Number of processes
+ *
+ * @return CSR holding transactions of rank, with the largest item ID of all ranks
+ */
+fpt_dyn_csr * fpt_pfp_read_file(
+    char const * const fname,
+    int rank,
+    int num_ranks)
+{
+  int fd;
+  if ((fd = open(fname, O_RDONLY)) < 0) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  struct stat st;
+  fstat(fd, &st);
+  size_t size = st.st_size;
+
+  char const * data = fpt_son_map(fd, size);
+
+  size_t start = 0;
+  if (rank > 0) {
+    start = fpt_son_partition_end(data, size, 0, size / num_ranks * rank);
+  }
+  size_t end = size;
+  if (rank < num_ranks-1) {
+    end = fpt_son_partition_end(data, size, 0, size / num_ranks * (rank+1));
+  }
+
+  fpt_dyn_csr * csr = fpt_son_read_partition(data + start, data + end, 0);
+
+  size_t released = 0;
+  fpt_son_release(data, size, &released, size);
+  close(fd);
+
+  MPI_Allreduce(MPI_IN_PLACE, &csr->max_val, 1, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+  return csr;
+}
+
+/*
+ * @brief Send each rank the group-dependent transactions of its item group.
+ *        Items are dealt to groups round-robin and group g belongs to rank g.
+ *        For each group with an item in a transaction, the prefix of the
+ *        transaction up to its last item of the group goes to that group, so
+ *        a rank sees every prefix path of the items it mines.
+ *
+ * @param trans Relabeled transactions read by calling rank
+ * @param num_ranks Number of processes
+ *
+ * @return Group-dependent transactions of calling rank
+ */
+fpt_csr * fpt_pfp_shuffle(
+    fpt_csr * trans,
+    int num_ranks)
+{
+  int * send_rows = calloc(num_ranks, sizeof(*send_rows));
+  int * send_vals = calloc(num_ranks, sizeof(*send_vals));
+  int * row_displs = malloc(num_ranks * sizeof(*row_displs));
+  int * val_displs = malloc(num_ranks * sizeof(*val_displs));
+  int * row_pos = malloc(num_ranks * sizeof(*row_pos));
+  int * val_pos = malloc(num_ranks * sizeof(*val_pos));
+  int * last_row = malloc(num_ranks * sizeof(*last_row));
+
+  /* Count rows and items going to each rank */
+  for (int g=0; g<num_ranks; g++) {
+    last_row[g] = -1;
+  }
+  for (int i=0; i<trans->nrows; i++) {
+    for (int j=trans->row_idx[i+1]-1; j>=trans->row_idx[i]; j--) {
+      int g = (trans->val[j]-1) % num_ranks;
+      if (last_row[g] != i) {
+        last_row[g] = i;
+        send_rows[g] += 1;
+        send_vals[g] += j - trans->row_idx[i] + 1;
+      }
+    }
+  }
+
+  int total_rows = 0;
+  int total_vals = 0;
+  for (int g=0; g<num_ranks; g++) {
+    row_displs[g] = row_pos[g] = total_rows;
+    val_displs[g] = val_pos[g] = total_vals;
+    total_rows += send_rows[g];
+    total_vals += send_vals[g];
+  }
+
+  /* Fill send buffers grouped by destination: row lengths and items */
+  int * row_buf = malloc(total_rows * sizeof(*row_buf));
+  int * val_buf = malloc(total_vals * sizeof(*val_buf));
+  for (int g=0; g<num_ranks; g++) {
+    last_row[g] = -1;
+  }
+  for (int i=0; i<trans->nrows; i++) {
+    int * items = &trans->val[trans->row_idx[i]];
+    int len = trans->row_idx[i+1] - trans->row_idx[i];
+
+    for (int j=len-1; j>=0; j--) {
+      int g = (items[j]-1) % num_ranks;
+      if (last_row[g] != i) {
+        last_row[g] = i;
+        row_buf[row_pos[g]++] = j+1;
+        memcpy(&val_buf[val_pos[g]], items, (j+1) * sizeof(*items));
+        val_pos[g] += j+1;
+      }
+    }
+  }
+
+  int * recv_rows = malloc(num_ranks * sizeof(*recv_rows));
+  int * recv_vals = malloc(num_ranks * sizeof(*recv_vals));
+  MPI_Alltoall(send_rows, 1, MPI_INT, recv_rows, 1, MPI_INT, MPI_COMM_WORLD);
+  MPI_Alltoall(send_vals, 1, MPI_INT, recv_vals, 1, MPI_INT, MPI_COMM_WORLD);
+
+  int * recv_row_displs = malloc(num_ranks * sizeof(*recv_row_displs));
+  int * recv_val_displs = malloc(num_ranks * sizeof(*recv_val_displs));
+  int nrows = 0;
+  int nnz = 0;
+  for (int g=0; g<num_ranks; g++) {
+    recv_row_displs[g] = nrows;
+    recv_val_displs[g] = nnz;
+    nrows += recv_rows[g];
+    nnz += recv_vals[g];
+  }
+
+  fpt_csr * group_trans = fpt_malloc_csr(nrows, nnz);
+  group_trans->max_val = trans->max_val;
+
+  /* Row lengths land in row_idx[1..nrows] and are turned into offsets */
+  MPI_Alltoallv(row_buf, send_rows, row_displs, MPI_INT,
+      group_trans->row_idx + 1, recv_rows, recv_row_displs, MPI_INT, MPI_COMM_WORLD);
+  MPI_Alltoallv(val_buf, send_vals, val_displs, MPI_INT,
+      group_trans->val, recv_vals, recv_val_displs, MPI_INT, MPI_COMM_WORLD);
+
+  group_trans->row_idx[0] = 0;
+  for (int i=1; i<=nrows; i++) {
+    group_trans->row_idx[i] += group_trans->row_idx[i-1];
+  }
+
+  free(send_rows);
+  free(send_vals);
+  free(row_displs);
+  free(val_displs);
+  free(row_pos);
+  free(val_pos);
+  free(last_row);
+  free(row_buf);
+  free(val_buf);
+  free(recv_rows);
+  free(recv_vals);
+  free(recv_row_displs);
+  free(recv_val_displs);
+
+  return group_trans;
+}
+
+/*
+ * @brief Mine the suffix items of the calling rank's group from the FP tree of
+ *        its group-dependent transactions, then gather all itemsets at rank 0
+ *        in the order fpt_find_frequent_itemsets finds them
+ *
+ * @param tree Pointer to root of FP tree built from group-dependent transactions
+ * @param num_trans Number of group-dependent transactions of calling rank
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param verbose Print statistics of each rank
+ * @param freq_itemsets Container for holding frequent itemsets (filled on rank 0 only)
+ * @param arenas Arenas for each level of recursion; allocation statistics of all threads are added to these
+ * @param cons Constraints on itemsets (NULL for none)
+ */
+void fpt_pfp_find_frequent_itemsets(
+    fpt_node * tree,
+    int num_trans,
+    int min_freq,
+    int verbose,
+    fpt_freq_itemsets * freq_itemsets,
+    fpt_arena ** arenas,
+    const fpt_constraints * cons)
+{
+  int rank;
+  int num_ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+
+  int max_item_ID = tree->max_item_ID;
+  int * seg_thread = malloc(max_item_ID * sizeof(*seg_thread));
+  int * seg_first = calloc(max_item_ID, sizeof(*seg_first));
+  int * seg_last = calloc(max_item_ID, sizeof(*seg_last));
+
+  double start = monotonic_seconds();
+
+  /* Items are dealt to ranks in turn */
+  for (int i=max_item_ID; i>0; i--) {
+    seg_thread[i-1] = (i-1) % num_ranks;
+  }
+
+  fpt_freq_itemsets * local_itemsets = fpt_freq_itemsets_init();
+  fpt_tree_miner data = {tree, min_freq, cons, arenas};
+  fpt_suffix_miner miner = {&data, fpt_tree_miner_scratch_init, fpt_tree_miner_mine, fpt_tree_miner_scratch_free};
+  fpt_mine_suffix_items_parallel(&miner, max_item_ID, rank, num_ranks, local_itemsets, seg_first, seg_last);
+
+  double mine_time = monotonic_seconds() - start;
+
+  /* Only the owner of an item has a nonzero segment */
+  MPI_Reduce((rank == 0) ? MPI_IN_PLACE : seg_first, seg_first, max_item_ID, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Reduce((rank == 0) ? MPI_IN_PLACE : seg_last, seg_last, max_item_ID, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+
+  int sizes[2] = {local_itemsets->supports->num_elements, local_itemsets->itemsets->num_elements};
+  int * all_sizes = malloc(2 * num_ranks * sizeof(*all_sizes));
+  MPI_Gather(sizes, 2, MPI_INT, all_sizes, 2, MPI_INT, 0, MPI_COMM_WORLD);
+
+  int * ind_counts = NULL;
+  int * ind_displs = NULL;
+  int * set_counts = NULL;
+  int * set_displs = NULL;
+  int * val_counts = NULL;
+  int * val_displs = NULL;
+  int * all_ind = NULL;
+  int * all_supps = NULL;
+  int * all_vals = NULL;
+
+  if (rank == 0) {
+    ind_counts = malloc(num_ranks * sizeof(*ind_counts));
+    ind_displs = malloc(num_ranks * sizeof(*ind_displs));
+    set_counts = malloc(num_ranks * sizeof(*set_counts));
+    set_displs = malloc(num_ranks * sizeof(*set_displs));
+    val_counts = malloc(num_ranks * sizeof(*val_counts));
+    val_displs = malloc(num_ranks * sizeof(*val_displs));
+
+    int num_ind = 0;
+    int num_sets = 0;
+    int num_vals = 0;
+    for (int r=0; r<num_ranks; r++) {
+      ind_counts[r] = all_sizes[2*r] + 1;
+      ind_displs[r] = num_ind;
+      set_counts[r] = all_sizes[2*r];
+      set_displs[r] = num_sets;
+      val_counts[r] = all_sizes[2*r+1];
+      val_displs[r] = num_vals;
+      num_ind += ind_counts[r];
+      num_sets += set_counts[r];
+      num_vals += val_counts[r];
+    }
+
+    all_ind = malloc(num_ind * sizeof(*all_ind));
+    all_supps = malloc(num_sets * sizeof(*all_supps));
+    all_vals = malloc(num_vals * sizeof(*all_vals));
+  }
+
+  MPI_Gatherv(local_itemsets->itemset_ind->array, sizes[0] + 1, MPI_INT,
+      all_ind, ind_counts, ind_displs, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Gatherv(local_itemsets->supports->array, sizes[0], MPI_INT,
+      all_supps, set_counts, set_displs, MPI_INT, 0, MPI_COMM_WORLD);
+  MPI_Gatherv(local_itemsets->itemsets->array, sizes[1], MPI_INT,
+      all_vals, val_counts, val_displs, MPI_INT, 0, MPI_COMM_WORLD);
+
+  double stats[2] = {num_trans, mine_time};
+  double * all_stats = malloc(2 * num_ranks * sizeof(*all_stats));
+  MPI_Gather(stats, 2, MPI_DOUBLE, all_stats, 2, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    fpt_freq_itemsets ** rank_itemsets = malloc(num_ranks * sizeof(*rank_itemsets));
+    for (int r=0; r<num_ranks; r++) {
+      rank_itemsets[r] = fpt_freq_itemsets_init();
+      fpt_dyn_array_add_values(rank_itemsets[r]->itemsets, all_vals + val_displs[r], val_counts[r]);
+      fpt_dyn_array_add_values(rank_itemsets[r]->itemset_ind, all_ind + ind_displs[r] + 1, set_counts[r]);
+      fpt_dyn_array_add_values(rank_itemsets[r]->supports, all_supps + set_displs[r], set_counts[r]);
+    }
+
+    fpt_merge_thread_itemsets(freq_itemsets, rank_itemsets, max_item_ID, seg_thread, seg_first, seg_last);
+
+    if (verbose) {
+      for (int r=0; r<num_ranks; r++) {
+        printf("  Rank %d: %0.0f group-dependent transactions, %d itemsets, %0.04f seconds\n", r, all_stats[2*r], set_counts[r], all_stats[2*r+1]);
+      }
+    }
+
+    for (int r=0; r<num_ranks; r++) {
+      fpt_freq_itemsets_free(rank_itemsets[r]);
+    }
+    free(rank_itemsets);
+    free(ind_counts);
+    free(ind_displs);
+    free(set_counts);
+    free(set_displs);
+    free(val_counts);
+    free(val_displs);
+    free(all_ind);
+    free(all_supps);
+    free(all_vals);
+  }
+
+  fpt_freq_itemsets_free(local_itemsets);
+  free(all_sizes);
+  free(all_stats);
+  free(seg_thread);
+  free(seg_first);
+  free(seg_last);
+}
+#endif
+
+/*
+ * @brief Initialize an empty sliding window. Space for transactions grows as
+ *        they arrive, so it follows the input rather than the capacity.
+ *
+ * @param capacity Number of most recent transactions kept
+ *
+ * @return Allocated window
+ */
+fpt_window * fpt_window_init(
+    int capacity)
+{
+  fpt_window * window = malloc(sizeof(*window));
+
+  window->arena = fpt_arena_init();
+  window->tree = fpt_new_node(window->arena);
+  window->tree->root = window->tree;
+  window->tree->max_item_ID = 0;
+
+  window->capacity = capacity;
+  window->num_trans = 0;
+  window->oldest = 0;
+
+  window->lens_capacity = (capacity < DYN_ARRAY_INIT_CAPACITY) ? capacity : DYN_ARRAY_INIT_CAPACITY;
+  window->lens = malloc(window->lens_capacity * sizeof(*window->lens));
+
+  window->items_capacity = DYN_ARRAY_INIT_CAPACITY;
+  window->items = malloc(window->items_capacity * sizeof(*window->items));
+  window->head = 0;
+  window->tail = 0;
+
+  return window;
+}
+
+/*
+ * @brief Free sliding window
+ *
+ * @param window Window to free
+ */
+void fpt_window_free(
+    fpt_window * window)
+{
+  free(window->lens);
+  free(window->items);
+  free(window->tree->item_array);
+  fpt_arena_free(window->arena);
+  free(window);
+}
+
+/*
+ * @brief Take a transaction out of the window tree. Nodes whose count drops
+ *        to zero are released for reuse.
+ *
+ * @param window Sliding window
+ * @param start Position of first item of transaction in ring buffer
+ * @param len Number of items
+ */
+void fpt_window_remove_path(
+    fpt_window * window,
+    long start,
+    int len)
+{
+  fpt_node * node = window->tree;
+  long mask = window->items_capacity - 1;
+
+  for (int j=0; j<len; j++) {
+    fpt_node * child = fpt_find_child(node, window->items[(start + j) & mask]);
+
+    child->count -= 1;
+    if (child->count == 0) {
+      /* Nothing below a node is counted more often than the node */
+      fpt_release_subtree(child, window->arena);
+      return;
+    }
+
+    node = child;
+  }
+}
+
+/*
+ * @brief Add a transaction to the window, expiring the oldest one when the
+ *        window is full
+ *
+ * @param window Sliding window
+ * @param items Items of transaction (ascending order, no duplicates)
+ * @param len Number of items
+ */
+void fpt_window_add(
+    fpt_window * window,
+    int * items,
+    int len)
+{
+  int slot;
+  if (window->num_trans == window->capacity) {
+    slot = window->oldest;
+    fpt_window_remove_path(window, window->head, window->lens[slot]);
+    window->head += window->lens[slot];
+    window->oldest = (window->oldest + 1) % window->capacity;
+  }
+  else {
+    /* Oldest stays in slot 0 until window is full, so slots fill in order */
+    slot = window->num_trans;
+    if (slot == window->lens_capacity) {
+      window->lens_capacity = (2 * window->lens_capacity < window->capacity) ? 2 * window->lens_capacity : window->capacity;
+      window->lens = realloc(window->lens, window->lens_capacity * sizeof(*window->lens));
+    }
+    window->num_trans++;
+  }
+
+  /* Grow ring buffer, unwrapping its items to the front */
+  if (window->tail - window->head + len > window->items_capacity) {
+    long capacity = window->items_capacity;
+    while (window->tail - window->head + len > capacity) {
+      capacity *= 2;
+    }
+
+    int * grown = malloc(capacity * sizeof(*grown));
+    for (long pos=window->head; pos<window->tail; pos++) {
+      grown[pos - window->head] = window->items[pos & (window->items_capacity - 1)];
+    }
+    free(window->items);
+
+    window->items = grown;
+    window->items_capacity = capacity;
+    window->tail -= window->head;
+    window->head = 0;
+  }
+
+  window->lens[slot] = len;
+  for (int j=0; j<len; j++) {
+    window->items[(window->tail + j) & (window->items_capacity - 1)] = items[j];
+  }
+  window->tail += len;
+
+  fpt_insert_path(window->tree, items, len, 1, window->arena);
+  if (len > 0 && items[len-1] > window->tree->max_item_ID) {
+    window->tree->max_item_ID = items[len-1];
+  }
+}
+
+/*
+ * @brief Link the nodes of each item in the window tree, as the tree changes
+ *        between mining runs
+ *
+ * @param window Sliding window
+ */
+void fpt_window_link_items(
+    fpt_window * window)
+{
+  fpt_node * tree = window->tree;
+
+  free(tree->item_array);
+  tree->item_array = calloc(tree->max_item_ID + 1, sizeof(*tree->item_array));
+
+  fpt_create_item_pointers(tree);
+}
+
+/*
+ * @brief Count occurrences of each item in the window
+ *
+ * @param window Sliding window
+ *
+ * @return counts Array of counts for each item
+ */
+int * fpt_window_count_items(
+    fpt_window * window)
+{
+  fpt_window_link_items(window);
+
+  int * counts = calloc(window->tree->max_item_ID + 1, sizeof(*counts));
+  for (int i=0; i<window->tree->max_item_ID; i++) {
+    counts[i] = fpt_count_item(window->tree->item_array[i]);
+  }
+
+  return counts;
+}
+
+/*
+ * @brief Find frequent itemsets of the transactions in the window, mining the
+ *        window tree in place. Items keep their original IDs.
+ *
+ * @param window Sliding window
+ * @param min_freq Minimum frequency for frequent pattern
+ * @param freq_itemsets Container for holding frequent itemsets
+ */
+void fpt_window_find_frequent_itemsets(
+    fpt_window * window,
+    int min_freq,
+    fpt_freq_itemsets * freq_itemsets)
+{
+  fpt_node * tree = window->tree;
+  int max_item_ID = tree->max_item_ID;
+
+  fpt_window_link_items(window);
+
+  fpt_arena ** arenas = malloc((max_item_ID+1) * sizeof(*arenas));
+  for (int i=0; i<=max_item_ID; i++) {
+    arenas[i] = fpt_arena_init();
+  }
+  int * suffix = malloc((max_item_ID+1) * sizeof(*suffix));
+
+  /* Infrequent items stay in the window tree, so they are skipped here */
+  for (int i=max_item_ID; i>0; i--) {
+    if (tree->item_array[i-1] != NULL && fpt_count_item(tree->item_array[i-1]) >= min_freq) {
+      fpt_mine_suffix_item(tree, i, min_freq, suffix + max_item_ID + 1, 0, freq_itemsets, arenas, NULL);
+    }
+  }
+
+  for (int i=0; i<=max_item_ID; i++) {
+    fpt_arena_free(arenas[i]);
+  }
+  free(arenas);
+  free(suffix);
+}
+
+/*
+ * @brief Relabel itemsets mined from the window to sorted item IDs, in the
+ *        order fpt_find_frequent_itemsets finds them
+ *
+ * @param freq_itemsets Itemsets with original item IDs
+ * @param forward_map Map from original item IDs to sorted IDs
+ *
+ * @return New set of itemsets
+ */
+fpt_freq_itemsets * fpt_window_relabel_itemsets(
+    fpt_freq_itemsets * freq_itemsets,
+    const int * forward_map)
+{
+  int * items = freq_itemsets->itemsets->array;
+  for (int i=0; i<freq_itemsets->itemsets->num_elements; i++) {
+    items[i] = forward_map[items[i]-1];
+  }
+
+  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
+    int start = freq_itemsets->itemset_ind->array[i];
+    qsort(items + start, freq_itemsets->itemset_ind->array[i+1] - start, sizeof(*items), fpt_lt);
+  }
+
+  return fpt_select_freq_itemsets(freq_itemsets, 0, 1);
+}
+
+/*
+ * @brief Feed "trans_id item" lines to a sliding window as they arrive.
+ *        Lines of a transaction must be consecutive; a transaction enters the
+ *        window when the first line of the next one is read.
+ *
+ * @param window Sliding window
+ * @param fname Name of input file ("-" reads standard input)
+ * @param slide Mine the window every slide transactions (0 never)
+ * @param min_freq Minimum frequency for frequent pattern
+ *
+ * @return Number of transactions read
+ */
+long fpt_window_stream(
+    fpt_window * window,
+    char const * const fname,
+    int slide,
+    int min_freq)
+{
+  FILE * fin = stdin;
+  if (strcmp(fname, "-") && (fin = fopen(fname, "r")) == NULL) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  fpt_dyn_array * items = fpt_dyn_array_malloc();
+  int trans_id = -1;
+  long num_trans = 0;
+
+  char * line = NULL;
+  size_t cap = 0;
+  ssize_t read;
+
+  do {
+    read = getline(&line, &cap, fin);
+
+    char const * ptr = line;
+    char const * end = line + ((read > 0) ? read : 0);
+    while (ptr < end && (*ptr == ' ' || *ptr == '\t')) {
+      ptr++;
+    }
+    if (read >= 0 && (ptr == end || *ptr == '\n' || *ptr == '\r')) {
+      continue;
+    }
+
+    int id = (read >= 0) ? fpt_parse_int(&ptr, end) : -1;
 
-        fpt_dyn_array_add_values(freq_itemsets->itemsets, &suffix[-1 * suff_len], suff_len);
-        fpt_dyn_array_add(freq_itemsets->itemset_ind, freq_itemsets->itemset_ind->array[freq_itemsets->itemset_ind->num_elements-1] + suff_len);
+    if (id != trans_id && trans_id >= 0) {
+      /* Items in ascending order without duplicates */
+      qsort(items->array, items->num_elements, sizeof(*items->array), fpt_lt);
+      int len = 0;
+      for (int i=0; i<items->num_elements; i++) {
+        if (len == 0 || items->array[i] != items->array[len-1]) {
+          items->array[len++] = items->array[i];
+        }
+      }
 
-        fpt_node * cond_tree = fpt_create_conditional_tree(tree, i, min_freq);
-        fpt_find_frequent_itemsets(cond_tree, min_freq, suffix, suff_len, freq_itemsets);
+      fpt_window_add(window, items->array, len);
+      items->num_elements = 0;
+      num_trans++;
+
+      if (slide > 0 && num_trans % slide == 0) {
+        double start = monotonic_seconds();
+        fpt_freq_itemsets * found = fpt_freq_itemsets_init();
+        fpt_window_find_frequent_itemsets(window, min_freq, found);
+        printf("Window at transaction %ld: %d transactions, %d frequent itemsets, %0.04f seconds\n",
+            num_trans, window->num_trans, found->supports->num_elements, monotonic_seconds()-start);
+        fflush(stdout);
+        fpt_freq_itemsets_free(found);
+      }
+    }
+    trans_id = id;
 
-        suff_len -= 1;
-        fpt_delete_tree(cond_tree);
+    if (read >= 0) {
+      while (ptr < end && (*ptr == ' ' || *ptr == '\t')) {
+        ptr++;
       }
+      fpt_dyn_array_add(items, fpt_parse_int(&ptr, end));
     }
+  } while (read >= 0);
+
+  free(line);
+  fpt_dyn_array_free(items);
+  if (fin != stdin) {
+    fclose(fin);
+  }
+
+  return num_trans;
 }
 
 /*
- * @brief Generate rules from an itemset using right-hand sides of rules at previous level in tree
+ * @brief Split a comma separated list of thresholds
  *
- * @param itemset Frequent itemset to generate rules from
- * @param itemset_len Length of frequent itemset
- * @param itemset_supp Support of frequent itemset
- * @param num_rules Number of rules generated at previous level
- * @param min_conf Minimum confidence for valid rule
- * @param freq_itemsets Set of frequent itemsets discovered
- * @param rules Struct for holding rules as they are generated
- * @param rule_len Length of previously generated rules
- * @param prev_rules Pointer to beginning of rules generated at previous level of lattice
+ * @param str List of values (modified)
+ * @param num_vals Number of values found
+ *
+ * @return Array of values
  */
-void fpt_gen_rules(
-    int * itemset,
-    int itemset_len,
-    int itemset_supp,
-    double min_conf,
+double * fpt_parse_thresholds(
+    char * str,
+    int * num_vals)
+{
+  int max_vals = 1;
+  for (char * c = str; *c != '\0'; c++) {
+    if (*c == ',') {
+      max_vals++;
+    }
+  }
+
+  double * vals = malloc(max_vals * sizeof(*vals));
+
+  *num_vals = 0;
+  for (char * tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    vals[(*num_vals)++] = atof(tok);
+  }
+
+  return vals;
+}
+
+/*
+ * @brief Parse a single item ID
+ *
+ * @param tok Token holding the item ID
+ *
+ * @return item Item ID, or 0 if the token is not a positive integer
+ */
+int fpt_parse_item(
+    const char * tok)
+{
+  char * end;
+  errno = 0;
+  long item = strtol(tok, &end, 10);
+
+  if (end == tok || *end != '\0' || errno != 0 || item < 1 || item > INT_MAX) {
+    return 0;
+  }
+
+  return (int) item;
+}
+
+/*
+ * @brief Parse a comma separated list of item IDs
+ *
+ * @param str List of item IDs
+ *
+ * @return items Item IDs in the order given, or NULL if an ID is invalid
+ */
+fpt_dyn_array * fpt_parse_items(
+    char * str)
+{
+  fpt_dyn_array * items = fpt_dyn_array_malloc();
+
+  for (char * tok = strtok(str, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    int item = fpt_parse_item(tok);
+    if (item == 0) {
+      fprintf(stderr, "Invalid item ID: %s\n", tok);
+      fpt_dyn_array_free(items);
+      return NULL;
+    }
+    fpt_dyn_array_add(items, item);
+  }
+
+  return items;
+}
+
+/*
+ * @brief Read item IDs separated by whitespace from a file
+ *
+ * @param fname Name of file
+ *
+ * @return items Item IDs in the order given, or NULL if an ID is invalid
+ */
+fpt_dyn_array * fpt_read_items(
+    char const * const fname)
+{
+  FILE * fin;
+  if ((fin = fopen(fname, "r")) == NULL) {
+    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
+    exit(EXIT_FAILURE);
+  }
+
+  fpt_dyn_array * items = fpt_dyn_array_malloc();
+
+  char * line = NULL;
+  size_t len = 0;
+  while (getline(&line, &len, fin) >= 0) {
+    for (char * tok = strtok(line, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+      int item = fpt_parse_item(tok);
+      if (item == 0) {
+        fprintf(stderr, "Invalid item ID in '%s': %s\n", fname, tok);
+        fpt_dyn_array_free(items);
+        items = NULL;
+        break;
+      }
+      fpt_dyn_array_add(items, item);
+    }
+    if (items == NULL) {
+      break;
+    }
+  }
+
+  free(line);
+  fclose(fin);
+
+  return items;
+}
+
+/*
+ * @brief Give excluded items, and items missing from a list of allowed items,
+ *        a count of zero so they are removed along with infrequent items
+ *
+ * @param item_counts Count of each item (in terms of original IDs)
+ * @param max_val Largest item ID
+ * @param excluded Items to exclude (NULL for none)
+ * @param allowed Items to keep (NULL to keep all)
+ */
+void fpt_exclude_items(
+    int * item_counts,
+    int max_val,
+    const fpt_dyn_array * excluded,
+    const fpt_dyn_array * allowed)
+{
+  if (allowed != NULL) {
+    char * keep = calloc(max_val, sizeof(*keep));
+    for (int i=0; i<allowed->num_elements; i++) {
+      if (allowed->array[i] >= 1 && allowed->array[i] <= max_val) {
+        keep[allowed->array[i]-1] = 1;
+      }
+    }
+    for (int i=0; i<max_val; i++) {
+      if (!keep[i]) {
+        item_counts[i] = 0;
+      }
+    }
+    free(keep);
+  }
+
+  if (excluded != NULL) {
+    for (int i=0; i<excluded->num_elements; i++) {
+      if (excluded->array[i] >= 1 && excluded->array[i] <= max_val) {
+        item_counts[excluded->array[i]-1] = 0;
+      }
+    }
+  }
+}
+
+/*
+ * @brief Comparison operator for sorting thresholds in ascending order
+ *
+ * @param a Pointer to first threshold
+ * @param b Pointer to second threshold
+ */
+int fpt_threshold_lt(
+    const void * a,
+    const void * b)
+{
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+
+  return (x > y) - (x < y);
+}
+
+/*
+ * @brief Derive itemsets and rules for every pair of thresholds from itemsets
+ *        mined at the lowest support. Each support filters the table of the
+ *        next lower one, and rules for every confidence are generated from the
+ *        same filtered table. One CSV row is reported per pair.
+ *
+ * @param freq_itemsets Frequent itemsets at the lowest support
+ * @param mine_time Time taken to mine freq_itemsets
+ * @param supps Support counts in ascending order
+ * @param num_supps Number of support counts
+ * @param confs Confidence levels
+ * @param num_confs Number of confidence levels
+ * @param use_index Build hash index on each filtered table
+ * @param max_rule_bytes Memory limit for held rules
+ * @param report File to write report to
+ * @param ofname Prefix of rule files, written as ofname.supp.conf (NULL for none)
+ * @param map Transforms item IDs back to original IDs
+ *
+ * @return 0 on success, -1 if a rule file could not be opened
+ */
+int fpt_sweep(
     fpt_freq_itemsets * freq_itemsets,
-    fpt_rules * rules,
-    int rule_len,
-    int num_rules,
-    int * prev_rules)
+    double mine_time,
+    double * supps,
+    int num_supps,
+    double * confs,
+    int num_confs,
+    int use_index,
+    size_t max_rule_bytes,
+    FILE * report,
+    char * ofname,
+    int * map)
+{
+  fprintf(report, "min_supp,min_conf,mine_seconds,filter_seconds,itemsets,rule_seconds,rules\n");
+
+  fpt_freq_itemsets * prev = freq_itemsets;
+
+  for (int s=0; s<num_supps; s++) {
+    int min_supp = supps[s];
+
+    double start = monotonic_seconds();
+    fpt_freq_itemsets * filtered = fpt_filter_freq_itemsets(prev, min_supp);
+    if (use_index) {
+      fpt_itemset_index_build(filtered);
+    }
+    double filter_time = monotonic_seconds() - start;
+
+    for (int c=0; c<num_confs; c++) {
+      FILE * fout = NULL;
+      if (ofname != NULL) {
+        char * fname = malloc(strlen(ofname) + 64);
+        sprintf(fname, "%s.%d.%g", ofname, min_supp, confs[c]);
+        if ((fout = fopen(fname, "w")) == NULL) {
+          fprintf(stderr, "unable to open '%s' for writing.\n", fname);
+          free(fname);
+          fpt_freq_itemsets_free(filtered);
+          if (prev != freq_itemsets) {
+            fpt_freq_itemsets_free(prev);
+          }
+          return -1;
+        }
+        free(fname);
+      }
+
+      start = monotonic_seconds();
+      long num_rules = fpt_gen_all_rules_streaming(filtered, confs[c], max_rule_bytes, fout, map, NULL);
+      double rule_time = monotonic_seconds() - start;
+
+      if (fout != NULL) {
+        fclose(fout);
+      }
+
+      fprintf(report, "%d,%g,%0.04f,%0.04f,%d,%0.04f,%ld\n", min_supp, confs[c], mine_time, filter_time,
+          filtered->supports->num_elements, rule_time, num_rules);
+    }
+
+    if (prev != freq_itemsets) {
+      fpt_freq_itemsets_free(prev);
+    }
+    prev = filtered;
+  }
+
+  if (prev != freq_itemsets) {
+    fpt_freq_itemsets_free(prev);
+  }
+
+  return 0;
+}
+
+/*
+ * @brief Choose a mining engine from cheap statistics of the relabelled
+ *        transactions. The FP tree of an evenly spaced sample of transactions
+ *        estimates how well the full tree would compress. The choice and the
+ *        statistics behind it are logged to stderr.
+ *        - eclat: transactions cover enough of the items and the bitsets fit
+ *          in memory
+ *        - compact: the tree compresses poorly, so node storage dominates, and
+ *          there are few enough items for its per-item arrays
+ *        - fptree: otherwise
+ *
+ * @param trans CSR array of relabelled transactions
+ *
+ * @return Engine to use
+ */
+fpt_engine fpt_choose_engine(
+    fpt_csr * trans)
+{
+  int num_items = trans->max_val;
+  double avg_len = (trans->nrows > 0) ? (double) trans->nnz / trans->nrows : 0;
+  double density = (num_items > 0) ? avg_len / num_items : 0;
+  size_t bitset_bytes = (size_t) num_items * ((trans->nrows + 511) / 512 * 8) * sizeof(uint64_t);
+
+  /* Build FP tree of sample */
+  int stride = (trans->nrows > AUTO_SAMPLE_ROWS) ? trans->nrows / AUTO_SAMPLE_ROWS : 1;
+  int sample_rows = (trans->nrows + stride - 1) / stride;
+  int sample_nnz = 0;
+  for (int i=0; i<trans->nrows; i+=stride) {
+    sample_nnz += trans->row_idx[i+1] - trans->row_idx[i];
+  }
+
+  fpt_csr * sample = fpt_malloc_csr(sample_rows, sample_nnz);
+  sample->max_val = num_items;
+  sample->row_idx[0] = 0;
+  int r = 0;
+  for (int i=0; i<trans->nrows; i+=stride) {
+    int len = trans->row_idx[i+1] - trans->row_idx[i];
+    memcpy(&sample->val[sample->row_idx[r]], &trans->val[trans->row_idx[i]], len * sizeof(*sample->val));
+    sample->row_idx[r+1] = sample->row_idx[r] + len;
+    r++;
+  }
+
+  fpt_arena * arena = fpt_arena_init();
+  fpt_create_fp_tree(sample, arena);
+  double ratio = (sample_nnz > 0) ? (double) (arena->nodes_allocated - 1) / sample_nnz : 0;
+  fpt_arena_free(arena);
+  fpt_free_csr(sample);
+
+  fpt_engine engine;
+  char const * reason;
+  if (density >= AUTO_ECLAT_MIN_DENSITY && bitset_bytes <= AUTO_ECLAT_MAX_BYTES) {
+    engine = FPT_ENGINE_ECLAT;
+    reason = "dense enough for bitsets";
+  }
+  else if (ratio >= AUTO_COMPACT_MIN_RATIO && num_items <= AUTO_COMPACT_MAX_ITEMS) {
+    engine = FPT_ENGINE_COMPACT;
+    reason = "tree compresses poorly";
+  }
+  else if (ratio >= AUTO_COMPACT_MIN_RATIO) {
+    engine = FPT_ENGINE_FPTREE;
+    reason = "tree compresses poorly but too many items for compact";
+  }
+  else {
+    engine = FPT_ENGINE_FPTREE;
+    reason = "tree compresses well";
+  }
+
+  fprintf(stderr, "Engine: %s (%s; avg length %0.2f, %d frequent items, density %0.4f, bitsets %zu bytes, sample tree %0.2f nodes per item occurrence)\n",
+      (engine == FPT_ENGINE_ECLAT) ? "eclat" : (engine == FPT_ENGINE_COMPACT) ? "compact" : "fptree",
+      reason, avg_len, num_items, density, bitset_bytes, ratio);
+
+  return engine;
+}
+
+/*
+ * @brief Print allocation statistics for the arena of each recursion level
+ *
+ * @param arenas Arenas for each level of recursion
+ * @param num_levels Number of arenas
+ */
+void fpt_print_arena_stats(
+    fpt_arena ** arenas,
+    int num_levels)
+{
+  for (int i=0; i<num_levels; i++) {
+    if (arenas[i]->nodes_allocated > 0) {
+      printf("Level %d: %ld nodes, %ld bytes allocated, %zu bytes reserved\n", i, arenas[i]->nodes_allocated, arenas[i]->bytes_allocated, arenas[i]->bytes_reserved);
+    }
+  }
+}
+
+/*
+ * @brief Print usage message
+ *
+ * @param prog Name of executable
+ */
+void fpt_print_usage(
+    char const * const prog)
+{
+  fprintf(stderr, "usage: %s [-v] [-e engine] [-t threads] [-w paths] [-H] [-m MB] [-l loader] [-c cache] [-r report] [-M mode] [-k num] [-L len] [-P MB] [-W size] [-S slide] [-s] [-x len] [-a items] [-n items] [-A file] [-T] min_supp min_conf ifname [ofname]\n", prog);
+  fprintf(stderr, "  -v          Print build and sort timings, per-level allocation statistics, per-worker,\n");
+  fprintf(stderr, "              per-rank, per-partition and window statistics, support index and itemset\n");
+  fprintf(stderr, "              trie statistics and candidate rule counts per consequent length\n");
+  fprintf(stderr, "  -e engine   Mining engine: auto (default), fptree, compact or eclat\n");
+  fprintf(stderr, "  -t threads  Number of threads used for mining and rule generation (default 1)\n");
+  fprintf(stderr, "  -w paths    Use work stealing; conditional trees with this many prefix paths become tasks\n");
+  fprintf(stderr, "  -H          Build a hash index for itemset support lookups during rule generation\n");
+  fprintf(stderr, "  -m MB       Stream rules to ofname, holding about MB megabytes of rules (any min_supp)\n");
+  fprintf(stderr, "  -l loader   Transaction file loader: mmap (default) or stdio\n");
+  fprintf(stderr, "  -c cache    Binary transaction cache; read if up to date with ifname, otherwise written\n");
+  fprintf(stderr, "  -r report   CSV report for sweeps (default stdout)\n");
+  fprintf(stderr, "  -M mode     Itemsets found: all (default), closed or maximal; mining is serial\n");
+  fprintf(stderr, "              and rules come from closed itemsets only\n");
+  fprintf(stderr, "  -k num      Find the num most frequent itemsets (ties kept); min_supp is the lowest support allowed;\n");
+  fprintf(stderr, "              mining is serial\n");
+  fprintf(stderr, "  -L len      With -k, only count and report itemsets with at least len items (no rules)\n");
+  fprintf(stderr, "  -P MB       Mine the file in partitions of about MB megabytes of memory each (two passes over\n");
+  fprintf(stderr, "              ifname); candidate itemsets are held in memory in addition\n");
+  fprintf(stderr, "  -s          Sort transactions lexicographically before building the FP tree\n");
+  fprintf(stderr, "  -x len      Only find itemsets with at most len items\n");
+  fprintf(stderr, "  -a items    Only find itemsets holding one of these comma separated items (no rules)\n");
+  fprintf(stderr, "  -n items    Leave out these comma separated items\n");
+  fprintf(stderr, "  -A file     Only use the items listed in file (separated by whitespace)\n");
+  fprintf(stderr, "  -T          Hold itemsets in a suffix trie for rule generation and output\n");
+  fprintf(stderr, "  -W size     Keep the last size transactions of ifname (- for standard input) in a sliding\n");
+  fprintf(stderr, "              window tree and mine the final window\n");
+  fprintf(stderr, "  -S slide    With -W, also mine the window every slide transactions and print a summary\n");
+  fprintf(stderr, "Comma separated lists of min_supp and min_conf run a sweep: itemsets are mined once at the\n");
+  fprintf(stderr, "lowest support and rules for each pair are written to ofname.supp.conf\n");
+#ifdef FPT_MPI
+  fprintf(stderr, "Under mpirun with several ranks, each rank mines one group of items from the\n");
+  fprintf(stderr, "transactions it is sent (parallel FP-growth) and rank 0 writes the results\n");
+#endif
+}
+
+int main(
+    int argc,
+    char ** argv)
 {
-  fpt_dyn_array * cand_rules = fpt_dyn_array_malloc();
+  int verbose = 0;
+  fpt_engine engine = FPT_ENGINE_AUTO;
+  int num_threads = 1;
+  int task_threshold = 0;
+  int use_index = 0;
+  size_t max_rule_bytes = 0;
+  fpt_loader loader = FPT_LOADER_MMAP;
+  char * cache_fname = NULL;
+  char * report_fname = NULL;
+  fpt_mode mode = FPT_MODE_ALL;
+  int top_k = 0;
+  int top_k_min_len = 1;
+  size_t part_bytes = 0;
+  int window_size = 0;
+  int window_slide = 0;
+  int sort_trans = 0;
+  int use_trie = 0;
+  fpt_constraints cons = {0, NULL};
+  fpt_dyn_array * required_items = NULL;
+  fpt_dyn_array * excluded_items = NULL;
+  fpt_dyn_array * allowed_items = NULL;
+
+  int rank = 0;
+  int num_ranks = 1;
+#ifdef FPT_MPI
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &num_ranks);
+
+  /* Only rank 0 reports results */
+  if (rank > 0 && freopen("/dev/null", "w", stdout) == NULL) {
+    fprintf(stderr, "unable to silence rank %d.\n", rank);
+  }
+#endif
+
+  int opt;
+  while ((opt = getopt(argc, argv, "ve:t:w:Hm:l:c:r:M:k:L:P:W:S:sx:a:n:A:T")) != -1) {
+    switch (opt) {
+      case 'v':
+        verbose = 1;
+        break;
+      case 'e':
+        if (!strcmp(optarg, "fptree")) {
+          engine = FPT_ENGINE_FPTREE;
+        }
+        else if (!strcmp(optarg, "compact")) {
+          engine = FPT_ENGINE_COMPACT;
+        }
+        else if (!strcmp(optarg, "eclat")) {
+          engine = FPT_ENGINE_ECLAT;
+        }
+        else if (!strcmp(optarg, "auto")) {
+          engine = FPT_ENGINE_AUTO;
+        }
+        else {
+          fprintf(stderr, "Invalid engine: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 't':
+        num_threads = atoi(optarg);
+        if (num_threads < 1) {
+          fprintf(stderr, "Invalid number of threads: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'w':
+        task_threshold = atoi(optarg);
+        if (task_threshold < 1) {
+          fprintf(stderr, "Invalid task threshold: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'H':
+        use_index = 1;
+        break;
+      case 'm':
+        if (atof(optarg) <= 0) {
+          fprintf(stderr, "Invalid rule memory limit: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        max_rule_bytes = atof(optarg) * 1024 * 1024;
+        break;
+      case 'l':
+        if (!strcmp(optarg, "mmap")) {
+          loader = FPT_LOADER_MMAP;
+        }
+        else if (!strcmp(optarg, "stdio")) {
+          loader = FPT_LOADER_STDIO;
+        }
+        else {
+          fprintf(stderr, "Invalid loader: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'c':
+        cache_fname = optarg;
+        break;
+      case 'r':
+        report_fname = optarg;
+        break;
+      case 'M':
+        if (!strcmp(optarg, "all")) {
+          mode = FPT_MODE_ALL;
+        }
+        else if (!strcmp(optarg, "closed")) {
+          mode = FPT_MODE_CLOSED;
+        }
+        else if (!strcmp(optarg, "maximal")) {
+          mode = FPT_MODE_MAXIMAL;
+        }
+        else {
+          fprintf(stderr, "Invalid mode: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'k':
+        top_k = atoi(optarg);
+        if (top_k < 1) {
+          fprintf(stderr, "Invalid number of itemsets: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'L':
+        top_k_min_len = atoi(optarg);
+        if (top_k_min_len < 1) {
+          fprintf(stderr, "Invalid minimum length: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'P':
+        if (atof(optarg) <= 0) {
+          fprintf(stderr, "Invalid partition memory budget: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        part_bytes = atof(optarg) * 1024 * 1024;
+        break;
+      case 's':
+        sort_trans = 1;
+        break;
+      case 'T':
+        use_trie = 1;
+        break;
+      case 'x':
+        cons.max_len = atoi(optarg);
+        if (cons.max_len < 1) {
+          fprintf(stderr, "Invalid maximum length: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'a':
+        required_items = fpt_parse_items(optarg);
+        if (required_items == NULL) {
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'n':
+        excluded_items = fpt_parse_items(optarg);
+        if (excluded_items == NULL) {
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'A':
+        allowed_items = fpt_read_items(optarg);
+        if (allowed_items == NULL) {
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'W':
+        window_size = atoi(optarg);
+        if (window_size < 1) {
+          fprintf(stderr, "Invalid window size: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      case 'S':
+        window_slide = atoi(optarg);
+        if (window_slide < 1) {
+          fprintf(stderr, "Invalid window slide: %s\n", optarg);
+          return EXIT_FAILURE;
+        }
+        break;
+      default:
+        fpt_print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
 
-  if (itemset_len > rule_len + 1) {
+  if (argc - optind < 3) {
+    fpt_print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
 
-    /* Generate candidate rules */
-    /* First handle generation of rules of length 1 */
-    if (rule_len == 0) {
-      fpt_dyn_array_add_values(cand_rules, itemset, itemset_len);
-    }
+  int constrained = (cons.max_len > 0 || required_items != NULL);
 
-    for (int i=0; i<num_rules; i++) {
-      int j = i+1;
-      while (j<num_rules) {
-        if ( memcmp(&prev_rules[i*rule_len], &prev_rules[j*rule_len], (rule_len-1)*sizeof(*prev_rules)) == 0 ) {  /* Prefixes match */
-          fpt_dyn_array_add_values(cand_rules, &prev_rules[i*rule_len], rule_len);
-          fpt_dyn_array_add(cand_rules, prev_rules[(j+1)*rule_len - 1]);
-        }
-        j += 1;
-      }
+  /* Work stealing, closed/maximal, top-k, partitioned, window, constrained and distributed mining only exist for the fptree engine */
+  if (engine == FPT_ENGINE_AUTO && (task_threshold > 0 || mode != FPT_MODE_ALL || top_k > 0 || part_bytes > 0 || window_size > 0 || constrained || num_ranks > 1)) {
+    if (rank == 0) {
+      fprintf(stderr, "Engine: fptree (required by -w, -M, -k, -P, -W, -x, -a or MPI)\n");
     }
+    engine = FPT_ENGINE_FPTREE;
+  }
 
-    /* Prune candidates */
-    int * marker = malloc(cand_rules->num_elements/(rule_len+1) * sizeof(*marker) );
-    for (int i=0; i<cand_rules->num_elements/(rule_len+1); i++) {
-      marker[i] = 1;
-      /* Handle new rules of length 1 */
-      if (rule_len == 0) {
-        marker[i] = 1;
-      }
-      else {
-        int match = 0;
-        for (int j=0; j<rule_len; j++) {
-          for (int k=0; k<num_rules; k++) {
-              if ( (memcmp( &cand_rules->array[i*(rule_len+1)], &prev_rules[k*rule_len], j) == 0) &&
-                  (memcmp( &cand_rules->array[i*(rule_len+1) + j + 1], &prev_rules[k*rule_len+j], rule_len-j) == 0) ) {    /* Subset is high confidence */
-                match = 1;
-                break;    /* Stop checking this subset of rule */
-              }
-            }
-          if (match == 0) {    /* Subrule did not have high confidence */
-            break;
-          }
-        }
-        if (match == 1) {   /* All subrules have high confidence */
-          marker[i] = 1;
-        }
-      }
-    }
+  if (task_threshold > 0 && engine != FPT_ENGINE_FPTREE) {
+    fprintf(stderr, "Work stealing (-w) requires the fptree engine\n");
+    return EXIT_FAILURE;
+  }
 
-    /* Check confidence of remaining rules */
-    int * lhs = malloc((itemset_len-(rule_len+1)) * sizeof(*lhs));
-    int num_new_rules = 0;
-    int total_prev_elements = rules->rhs->num_elements;    /* Need to keep the number of rules instead of a pointer in case dynamic array is expanded */
-    for (int i=0; i<cand_rules->num_elements/(rule_len+1); i++) {
-      if (marker[i] == 1) {
+  int num_supps;
+  int num_confs;
+  double * supps = fpt_parse_thresholds(argv[optind], &num_supps);
+  double * confs = fpt_parse_thresholds(argv[optind+1], &num_confs);
+  if (num_supps == 0 || num_confs == 0) {
+    fpt_print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  int sweep = (num_supps > 1 || num_confs > 1);
 
-        fpt_rule_lhs(itemset, itemset_len, &cand_rules->array[i * (rule_len+1)], rule_len+1, lhs);
+  if (mode != FPT_MODE_ALL && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || sweep)) {
+    fprintf(stderr, "Closed and maximal modes (-M) require the serial fptree engine and a single threshold\n");
+    return EXIT_FAILURE;
+  }
 
-        int supp = fpt_lookup_support(lhs, itemset_len-(rule_len+1), freq_itemsets);
+  if (top_k_min_len > 1 && top_k == 0) {
+    fprintf(stderr, "Minimum length (-L) requires top-k mining (-k)\n");
+    return EXIT_FAILURE;
+  }
 
-        double conf = itemset_supp / ( (double) supp);
+  if (top_k > 0 && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || sweep || mode != FPT_MODE_ALL)) {
+    fprintf(stderr, "Top-k mining (-k) requires the serial fptree engine, a single threshold and all itemsets\n");
+    return EXIT_FAILURE;
+  }
 
-        if (conf > min_conf) {
-          /* Add LHS of rule to set of rules */
-          fpt_dyn_array_add_values(rules->lhs, lhs, itemset_len-(rule_len+1));
-          fpt_dyn_array_add(rules->lhs_idx, rules->lhs_idx->array[rules->lhs_idx->num_elements-1] + itemset_len-(rule_len+1));
+  /* The support threshold rises as itemsets are found, so top-k mining is not split across threads */
+  if (top_k > 0 && num_threads > 1) {
+    fprintf(stderr, "Top-k mining (-k) mines with one thread; -t %d applies to loading and rule generation\n", num_threads);
+  }
 
-          /* Add RHS of rule to set of rules */
-          fpt_dyn_array_add_values(rules->rhs, &cand_rules->array[i*(rule_len+1)], rule_len+1);
-          fpt_dyn_array_add(rules->rhs_idx, rules->rhs_idx->array[rules->rhs_idx->num_elements-1] + rule_len+1);
+  if (part_bytes > 0 && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || mode != FPT_MODE_ALL || top_k > 0 || cache_fname != NULL)) {
+    fprintf(stderr, "Partitioned mining (-P) requires the fptree engine without -w, -M, -k or -c\n");
+    return EXIT_FAILURE;
+  }
 
-          /* Add support and confidence to set of rules */
-          fpt_dyn_array_add(rules->supp, itemset_supp);
-          fpt_dyn_array_dbl_add(rules->conf, conf);
+  if (num_ranks > 1 && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || mode != FPT_MODE_ALL || top_k > 0 || part_bytes > 0 || cache_fname != NULL)) {
+    fprintf(stderr, "Distributed mining requires the fptree engine without -w, -M, -k, -P or -c\n");
+    return EXIT_FAILURE;
+  }
 
-          num_new_rules++;
-        }
-      }
-    }
+  if (window_slide > 0 && window_size == 0) {
+    fprintf(stderr, "Window slide (-S) requires a window (-W)\n");
+    return EXIT_FAILURE;
+  }
 
-    free(marker);
-    free(lhs);
-    fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, rules, rule_len+1, num_new_rules, &rules->rhs->array[total_prev_elements]);
+  if (window_size > 0 && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || mode != FPT_MODE_ALL || top_k > 0 || part_bytes > 0 || cache_fname != NULL || num_ranks > 1)) {
+    fprintf(stderr, "Window mining (-W) requires the serial fptree engine without -w, -M, -k, -P, -c or MPI\n");
+    return EXIT_FAILURE;
   }
-  fpt_dyn_array_free(cand_rules);
-}
 
-/*
- * @brief Generate rules from all frequent itemsets
- *
- * @param freq_itemsets Set of all frequent itemsets
- * @param rules Struct to hold rules as they are generated
- * @param min_conf Minimum confidence level for valid rules
- */
-void fpt_gen_all_rules(
-    fpt_freq_itemsets * freq_itemsets,
-    fpt_rules * rules,
-    double min_conf)
-{
-  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
-    int * itemset = &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[i]];
-    int itemset_len = freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i];
-    int itemset_supp = freq_itemsets->supports->array[i];
-    fpt_gen_rules(itemset, itemset_len, itemset_supp, min_conf, freq_itemsets, rules, 0, 0, rules->rhs->array);
+  if (window_size > 0 && (constrained || excluded_items != NULL || allowed_items != NULL)) {
+    fprintf(stderr, "Window mining (-W) does not support item constraints (-x, -a, -n or -A)\n");
+    return EXIT_FAILURE;
   }
-}
 
-/*
- * @brief Create rules with empty RHS's (for use with small min_supp values)
- *
- * @param freq_itemsets Set of all frequent itemsets
- * @param rules Struct to hold rules
- */
-void fpt_create_empty_rules(
-    fpt_freq_itemsets * freq_itemsets,
-    fpt_rules * rules)
-{
-  for (int i=0; i<freq_itemsets->supports->num_elements; i++) {
-    fpt_dyn_array_add_values(rules->lhs, &freq_itemsets->itemsets->array[freq_itemsets->itemset_ind->array[i]], freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i]);
-    fpt_dyn_array_add(rules->lhs_idx, rules->lhs_idx->array[rules->lhs_idx->num_elements-1] + freq_itemsets->itemset_ind->array[i+1] - freq_itemsets->itemset_ind->array[i]);
+  if (constrained && (engine != FPT_ENGINE_FPTREE || task_threshold > 0 || mode != FPT_MODE_ALL || top_k > 0)) {
+    fprintf(stderr, "Maximum length (-x) and required items (-a) require the fptree engine without -w, -M or -k\n");
+    return EXIT_FAILURE;
+  }
 
-    fpt_dyn_array_add(rules->rhs_idx, 0);
+  /* Subsets without a required item are never mined, so rule confidences cannot be computed */
+  if (required_items != NULL && (sweep || max_rule_bytes > 0)) {
+    fprintf(stderr, "Required items (-a) find no rules, so they cannot be used with sweeps or -m\n");
+    return EXIT_FAILURE;
+  }
 
-    fpt_dyn_array_add(rules->supp, freq_itemsets->supports->array[i]);
-    fpt_dyn_array_dbl_add(rules->conf, -1);
+  /* Subsets of maximal itemsets are not stored, so rule confidences cannot be computed */
+  if (mode == FPT_MODE_MAXIMAL && max_rule_bytes > 0) {
+    fprintf(stderr, "Maximal itemsets (-M maximal) find no rules, so they cannot be used with -m\n");
+    return EXIT_FAILURE;
   }
-}
 
-/*
- * @brief Read datafile
- *
- * @param fname Name of file to read
- */
-fpt_dyn_csr * read_file(
-    char const * const fname)
-{
-  /* Open file */
-  FILE * fin;
-  if((fin = fopen(fname, "r")) == NULL) {
-    fprintf(stderr, "unable to open '%s' for reading.\n", fname);
-    exit(EXIT_FAILURE);
+  /* Top-k itemsets shorter than -L are not stored, so rule confidences cannot be computed */
+  if (top_k_min_len > 1 && max_rule_bytes > 0) {
+    fprintf(stderr, "Minimum length (-L) finds no rules, so it cannot be used with -m\n");
+    return EXIT_FAILURE;
   }
 
-  fpt_dyn_csr * csr = fpt_dyn_csr_init();
+  /* The trie needs every suffix of an itemset stored, and replaces the flat arrays other stores read */
+  if (use_trie && (use_index || sweep || max_rule_bytes > 0 || mode != FPT_MODE_ALL || top_k > 0 || required_items != NULL)) {
+    fprintf(stderr, "Itemset trie (-T) cannot be used with -H, -m, -M, -k, -a or sweeps\n");
+    return EXIT_FAILURE;
+  }
 
-  int num_items = 0;
-  int prev_trans_id = 0;
+  /* Mine at the lowest support */
+  qsort(supps, num_supps, sizeof(*supps), fpt_threshold_lt);
+  int min_supp = supps[0];
+  double min_conf = confs[0];
+  char * ifname = argv[optind+2];
+  char * ofname = NULL;
+  if (argc - optind > 3) {
+    ofname = argv[optind+3];
+  }
 
-  char * line = malloc(1024 * 1024);
-  size_t len = 0;
-  ssize_t read = getline(&line, &len, fin);
+  omp_set_num_threads(num_threads);
 
-  while (read >= 0) {
+  double start = monotonic_seconds();
 
-    char * ptr = strtok(line, " ");
-    char * end = NULL;
+  fpt_cache * cache = NULL;
+  if (cache_fname != NULL) {
+    cache = fpt_open_cache(cache_fname, ifname);
+  }
 
-    int trans_id = strtoull(ptr, &end, 10);
-    if (trans_id > prev_trans_id) {
-      prev_trans_id = trans_id;
-      fpt_dyn_array_add(csr->row_idx, num_items);
+  /* Partitioned and window mining only count items here and keep transactions elsewhere */
+  fpt_dyn_csr * trans_csr;
+  int * read_counts = NULL;
+  int num_trans = 0;
+  fpt_window * window = NULL;
+  if (part_bytes > 0) {
+    trans_csr = fpt_dyn_csr_init();
+    read_counts = fpt_son_count_items(ifname, part_bytes, &trans_csr->max_val, &num_trans);
+  }
+  else if (window_size > 0) {
+    window = fpt_window_init(window_size);
+    fpt_window_stream(window, ifname, window_slide, min_supp);
+    trans_csr = fpt_dyn_csr_init();
+    trans_csr->max_val = window->tree->max_item_ID;
+    read_counts = fpt_window_count_items(window);
+  }
+#ifdef FPT_MPI
+  else if (num_ranks > 1) {
+    trans_csr = fpt_pfp_read_file(ifname, rank, num_ranks);
+  }
+#endif
+  else if (cache != NULL) {
+    trans_csr = &cache->csr;
+  }
+  else if (loader == FPT_LOADER_MMAP) {
+    trans_csr = fpt_mmap_read_file(ifname);
+  }
+  else {
+    trans_csr = read_file(ifname);
+  }
+
+  int * item_counts = malloc(trans_csr->max_val * sizeof(*item_counts));
+  int * forward_map = malloc(trans_csr->max_val * sizeof(*forward_map));
+  int * backward_map = malloc(trans_csr->max_val * sizeof(*backward_map));
+
+  if (cache != NULL) {
+    memcpy(item_counts, cache->item_counts, trans_csr->max_val * sizeof(*item_counts));
+    memcpy(forward_map, cache->forward_map, trans_csr->max_val * sizeof(*forward_map));
+    memcpy(backward_map, cache->backward_map, trans_csr->max_val * sizeof(*backward_map));
+  }
+  else {
+    free(item_counts);
+    item_counts = (read_counts != NULL) ? read_counts : count_items(trans_csr);
+#ifdef FPT_MPI
+    if (num_ranks > 1) {
+      MPI_Allreduce(MPI_IN_PLACE, item_counts, trans_csr->max_val, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
     }
+#endif
 
-    ptr = strtok(NULL, " ");
-    end = NULL;
-    int item = strtoull(ptr, &end, 10);
-    if (item > csr->max_val) {
-      csr->max_val = item;
+    fpt_sort_item_IDs(item_counts, trans_csr->max_val, forward_map, backward_map);
+
+    if (cache_fname != NULL && fpt_write_cache(cache_fname, ifname, trans_csr, item_counts, forward_map, backward_map) != 0) {
+      fprintf(stderr, "unable to write cache '%s'.\n", cache_fname);
     }
-    fpt_dyn_array_add(csr->val, item);
+  }
 
-    num_items++;
+  /* Excluded items are dropped with the infrequent ones, so they never reach a tree */
+  if (excluded_items != NULL || allowed_items != NULL) {
+    fpt_exclude_items(item_counts, trans_csr->max_val, excluded_items, allowed_items);
+    fpt_sort_item_IDs(item_counts, trans_csr->max_val, forward_map, backward_map);
 
-    read = getline(&line, &len, fin);
+    if (excluded_items != NULL) {
+      fpt_dyn_array_free(excluded_items);
+    }
+    if (allowed_items != NULL) {
+      fpt_dyn_array_free(allowed_items);
+    }
   }
 
-  fpt_dyn_array_add(csr->row_idx, num_items);
+  if (verbose) {
+    double load_time = monotonic_seconds()-start;
+    struct stat st;
+    if (stat((cache != NULL) ? cache_fname : ifname, &st) != 0) {
+      st.st_size = 0;
+    }
+    printf("Loading%s: %0.04f seconds, %0.2f MB/s\n", (cache != NULL) ? " (cache)" : "", load_time, st.st_size / (1024.0 * 1024.0) / load_time);
+  }
 
-  fclose(fin);
+  fpt_csr * sorted_trans_csr = fpt_relabel_item_IDs(trans_csr, item_counts, forward_map, min_supp);
+  int max_val = trans_csr->max_val;
 
-  free(line);
+  if (cache != NULL) {
+    fpt_close_cache(cache);
+  }
+  else {
+    fpt_dyn_csr_free(trans_csr);
+  }
 
-  return csr;
+  int max_item_ID = sorted_trans_csr->max_val;
 
-}
+  if (required_items != NULL) {
+    cons.required = calloc(max_item_ID, sizeof(*cons.required));
+    for (int i=0; i<required_items->num_elements; i++) {
+      int item = required_items->array[i];
+      if (item >= 1 && item <= max_val && item_counts[item-1] >= min_supp) {
+        cons.required[forward_map[item-1]-1] = 1;
+      }
+    }
+    fpt_dyn_array_free(required_items);
+  }
 
-/*
- * @brief Write rules to output file
- *
- * @param rules Struct holding rules generated
- * @param ofname Name of output file
- * @param map Transforms item IDs back to original IDs
- */
-void fpt_write_rules_to_file(
-    fpt_rules * rules,
-    char * ofname,
-    int * map)
-{
-  FILE * fout = fopen(ofname, "w");
+#ifdef FPT_MPI
+  /* Each rank mines its item group from the group-dependent transactions it receives */
+  if (num_ranks > 1) {
+    fpt_csr * group_trans = fpt_pfp_shuffle(sorted_trans_csr, num_ranks);
+    fpt_free_csr(sorted_trans_csr);
+    sorted_trans_csr = group_trans;
+  }
+#endif
 
-  for (int i=0; i<rules->supp->num_elements; i++) {
-    for (int j=rules->lhs_idx->array[i]; j<rules->lhs_idx->array[i+1]; j++) {
-      fprintf(fout, "%d ", map[rules->lhs->array[j]-1]);
+  if (engine == FPT_ENGINE_AUTO) {
+    engine = fpt_choose_engine(sorted_trans_csr);
+  }
+
+  /* Only FP tree builds depend on the order of transactions */
+  if (sort_trans && engine != FPT_ENGINE_ECLAT) {
+    start = monotonic_seconds();
+    fpt_sort_transactions(sorted_trans_csr);
+    if (verbose) {
+      printf("Transaction sort: %0.04f seconds\n", monotonic_seconds()-start);
     }
-    fprintf(fout, "| ");
-    if ((rules->rhs_idx->array[i+1] - rules->rhs_idx->array[i]) == 0) {
-      fprintf(fout, "{} ");
+  }
+
+  int * suffix = malloc(max_item_ID * sizeof(*suffix));
+  suffix = suffix + max_item_ID;
+
+  fpt_freq_itemsets * freq_itemsets = fpt_freq_itemsets_init();
+
+  double mine_time;
+
+  if (engine == FPT_ENGINE_ECLAT) {
+    /* One bit per transaction, padded to whole 512-bit vectors */
+    int words = (sorted_trans_csr->nrows + 511) / 512 * 8;
+    fpt_eclat_class * items = fpt_eclat_create_class(sorted_trans_csr, words);
+
+    fpt_eclat_class ** levels = malloc((max_item_ID+1) * sizeof(*levels));
+    for (int i=0; i<=max_item_ID; i++) {
+      levels[i] = fpt_eclat_class_init();
+    }
+
+    start = monotonic_seconds();
+
+    if (num_threads > 1) {
+      fpt_eclat_find_frequent_itemsets_parallel(items, words, min_supp, freq_itemsets);
     }
     else {
-      for (int j=rules->rhs_idx->array[i]; j<rules->rhs_idx->array[i+1]; j++) {
-        fprintf(fout, "%d ", map[rules->rhs->array[j]-1]);
+      fpt_eclat_find_frequent_itemsets(items, words, min_supp, suffix, 0, freq_itemsets, levels);
+    }
+
+    mine_time = monotonic_seconds()-start;
+    printf("Frequent itemset generation: %0.04f seconds\n", mine_time);
+    printf("Number of frequent itemsets found: %d\n", freq_itemsets->supports->num_elements);
+
+    if (verbose) {
+      printf("Item bitsets: %d items, %zu bytes\n", max_item_ID, (size_t) max_item_ID * words * sizeof(uint64_t));
+      for (int i=1; i<=max_item_ID; i++) {
+        if (levels[i]->capacity > 0) {
+          printf("Level %d: %zu bytes reserved\n", i, (size_t) levels[i]->capacity * words * sizeof(uint64_t));
+        }
       }
     }
-    if (rules->conf->array[i] == -1) {
-      fprintf(fout, "| %d | %0.0f\n", rules->supp->array[i], rules->conf->array[i]);
+
+    for (int i=0; i<=max_item_ID; i++) {
+      fpt_eclat_class_free(levels[i]);
+    }
+    free(levels);
+    fpt_eclat_class_free(items);
+  }
+  else if (engine == FPT_ENGINE_COMPACT) {
+    start = monotonic_seconds();
+    fpt_ctree * fp_tree = fpt_ctree_create_fp_tree(sorted_trans_csr);
+    if (verbose) {
+      printf("FP tree build%s: %0.04f seconds\n", sort_trans ? " (sorted)" : "", monotonic_seconds()-start);
+    }
+
+    /* Conditional trees at each suffix length reuse the same arrays */
+    fpt_ctree ** levels = malloc((max_item_ID+1) * sizeof(*levels));
+    for (int i=0; i<=max_item_ID; i++) {
+      levels[i] = fpt_ctree_init();
+    }
+
+    start = monotonic_seconds();
+
+    if (num_threads > 1) {
+      fpt_ctree_find_frequent_itemsets_parallel(fp_tree, min_supp, freq_itemsets);
     }
     else {
-      fprintf(fout, "| %d | %0.04f\n", rules->supp->array[i], rules->conf->array[i]);
+      fpt_ctree_find_frequent_itemsets(fp_tree, min_supp, suffix, 0, freq_itemsets, levels);
     }
-  }
-}
 
-int main(
-    int argc,
-    char ** argv)
-{
-  int min_supp = atoi(argv[1]);
-  double min_conf = atof(argv[2]);
-  char * ifname = argv[3];
-  char * ofname = NULL;
-  if (argc > 3) {
-    ofname = argv[4];
+    mine_time = monotonic_seconds()-start;
+    printf("Frequent itemset generation: %0.04f seconds\n", mine_time);
+    printf("Number of frequent itemsets found: %d\n", freq_itemsets->supports->num_elements);
+
+    if (verbose) {
+      printf("FP tree: %d nodes, %zu bytes (%zu bytes with pointer nodes)\n", fp_tree->num_nodes, fpt_ctree_bytes(fp_tree), fp_tree->num_nodes * sizeof(fpt_node));
+      for (int i=1; i<=max_item_ID; i++) {
+        if (levels[i]->node_capacity > 0) {
+          printf("Level %d: %zu bytes reserved\n", i, fpt_ctree_bytes(levels[i]));
+        }
+      }
+    }
+
+    for (int i=0; i<=max_item_ID; i++) {
+      fpt_ctree_free(levels[i]);
+    }
+    free(levels);
+    fpt_ctree_free(fp_tree);
   }
+  else {
+    /* One arena for the FP tree and one for the conditional trees at each suffix length */
+    int num_levels = max_item_ID + 1;
+    fpt_arena ** arenas = malloc(num_levels * sizeof(*arenas));
+    for (int i=0; i<num_levels; i++) {
+      arenas[i] = fpt_arena_init();
+    }
 
-  fpt_dyn_csr * trans_csr = read_file(ifname);
+    start = monotonic_seconds();
+    fpt_node * fp_tree = fpt_create_fp_tree(sorted_trans_csr, arenas[0]);
+    if (verbose) {
+      printf("FP tree build%s: %0.04f seconds\n", sort_trans ? " (sorted)" : "", monotonic_seconds()-start);
+    }
 
-  int * item_counts = count_items(trans_csr);
+    fpt_worker * worker_stats = NULL;
 
-  int * forward_map = malloc(trans_csr->max_val * sizeof(*forward_map));
-  int * backward_map = malloc(trans_csr->max_val * sizeof(*backward_map));
+    start = monotonic_seconds();
 
-  fpt_sort_item_IDs(item_counts, trans_csr->max_val, forward_map, backward_map);
+    if (top_k > 0) {
+      fpt_topk * topk = fpt_topk_init(top_k, top_k_min_len, min_supp);
+      fpt_find_topk_itemsets(fp_tree, topk, suffix, 0, freq_itemsets, arenas);
 
-  fpt_csr * sorted_trans_csr = fpt_relabel_item_IDs(trans_csr, item_counts, forward_map, min_supp);
+      fpt_freq_itemsets * kept = fpt_topk_finish(freq_itemsets, topk);
+      fpt_freq_itemsets_free(freq_itemsets);
+      freq_itemsets = kept;
+
+      /* Rules and output follow the support threshold reached */
+      min_supp = topk->min_freq;
+      fpt_topk_free(topk);
+    }
+    else if (part_bytes > 0) {
+      fpt_freq_itemsets_free(freq_itemsets);
+      freq_itemsets = fpt_son_find_frequent_itemsets(ifname, part_bytes, item_counts, forward_map,
+          max_val, num_trans, min_supp, verbose, suffix, arenas, &cons);
+    }
+    else if (window != NULL) {
+      fpt_freq_itemsets * found = fpt_freq_itemsets_init();
+      fpt_window_find_frequent_itemsets(window, min_supp, found);
+
+      /* Same item IDs and order as mining the window's transactions from a file */
+      fpt_freq_itemsets_free(freq_itemsets);
+      freq_itemsets = fpt_window_relabel_itemsets(found, forward_map);
+      fpt_freq_itemsets_free(found);
 
-  fpt_dyn_csr_free(trans_csr);
+      if (verbose) {
+        printf("Window: %d transactions, %ld tree nodes allocated\n", window->num_trans, window->arena->nodes_allocated);
+      }
+      fpt_window_free(window);
+    }
+#ifdef FPT_MPI
+    else if (num_ranks > 1) {
+      fpt_pfp_find_frequent_itemsets(fp_tree, sorted_trans_csr->nrows, min_supp, verbose, freq_itemsets, arenas, &cons);
+    }
+#endif
+    else if (mode != FPT_MODE_ALL) {
+      fpt_node ** found = malloc(num_levels * sizeof(*found));
+      fpt_arena ** found_arenas = malloc(num_levels * sizeof(*found_arenas));
+      for (int i=0; i<num_levels; i++) {
+        found_arenas[i] = fpt_arena_init();
+      }
+      found[0] = fpt_cfi_tree_init(max_item_ID, found_arenas[0]);
 
-  fpt_node * fp_tree = fpt_create_fp_tree(sorted_trans_csr);
+      fpt_find_closed_itemsets(fp_tree, min_supp, mode, suffix, 0, freq_itemsets, found, found_arenas, arenas);
 
-  int * suffix = malloc((fp_tree->max_item_ID) * sizeof(*suffix));
-  suffix = suffix + fp_tree->max_item_ID;
+      for (int i=0; i<num_levels; i++) {
+        fpt_arena_free(found_arenas[i]);
+      }
+      free(found_arenas);
+      free(found);
 
-  fpt_freq_itemsets * freq_itemsets = fpt_freq_itemsets_init();
+      if (mode == FPT_MODE_CLOSED) {
+        fpt_superset_index_build(freq_itemsets, max_item_ID);
+      }
+    }
+    else if (task_threshold > 0) {
+      worker_stats = fpt_find_frequent_itemsets_ws(fp_tree, min_supp, task_threshold, freq_itemsets, arenas);
+    }
+    else if (num_threads > 1) {
+      fpt_find_frequent_itemsets_parallel(fp_tree, min_supp, freq_itemsets, arenas, &cons);
+    }
+    else {
+      fpt_find_frequent_itemsets(fp_tree, min_supp, suffix, 0, freq_itemsets, arenas, &cons);
+    }
 
-  double start = monotonic_seconds();
+    mine_time = monotonic_seconds()-start;
+    printf("Frequent itemset generation: %0.04f seconds\n", mine_time);
+    printf("Number of frequent itemsets found: %d\n", freq_itemsets->supports->num_elements);
+    if (top_k > 0) {
+      printf("Top-k support threshold: %d\n", min_supp);
+    }
+    if (worker_stats != NULL) {
+      if (verbose) {
+        for (int w=0; w<num_threads; w++) {
+          printf("  Worker %d: %ld tasks run, %ld steals, %0.04f seconds idle\n", w, worker_stats[w].tasks_run, worker_stats[w].steals, worker_stats[w].idle_time);
+        }
+      }
+      free(worker_stats);
+    }
 
-  fpt_find_frequent_itemsets(fp_tree, min_supp, suffix, 0, freq_itemsets);
+    if (verbose) {
+      fpt_print_arena_stats(arenas, num_levels);
+    }
 
-  printf("Frequent itemset generation: %0.04f seconds\n", monotonic_seconds()-start);
-  printf("Number of frequent itemsets found: %d\n", freq_itemsets->supports->num_elements);
+    for (int i=0; i<num_levels; i++) {
+      fpt_arena_free(arenas[i]);
+    }
+    free(arenas);
+  }
 
-  suffix = suffix - fp_tree->max_item_ID;
+  suffix = suffix - max_item_ID;
   free(suffix);
 
+#ifdef FPT_MPI
+  /* Itemsets were gathered at rank 0, which generates and writes rules */
+  if (rank > 0) {
+    free(supps);
+    free(confs);
+    free(item_counts);
+    free(forward_map);
+    free(backward_map);
+    free(cons.required);
+    fpt_freq_itemsets_free(freq_itemsets);
+    fpt_free_csr(sorted_trans_csr);
+    MPI_Finalize();
+    return EXIT_SUCCESS;
+  }
+#endif
+
+  /* Rules are only generated from all itemsets at supports where they fit in memory */
+  int gen_rules = (max_rule_bytes > 0) || (min_supp > 20 && mode != FPT_MODE_MAXIMAL && top_k_min_len == 1 && cons.required == NULL);
+
+  if (use_index && !sweep && gen_rules) {
+    fpt_build_support_index(freq_itemsets, verbose);
+  }
+
+  if (use_trie) {
+    size_t flat_bytes = fpt_freq_itemsets_bytes(freq_itemsets);
+    start = monotonic_seconds();
+    if (fpt_itemset_trie_build(freq_itemsets) != 0) {
+      fprintf(stderr, "Itemsets are not in FP-growth order; keeping flat itemsets\n");
+    }
+    else if (verbose) {
+      printf("Itemset trie: %0.04f seconds to build, %zu bytes (%zu bytes flat)\n", monotonic_seconds()-start, fpt_freq_itemsets_bytes(freq_itemsets), flat_bytes);
+    }
+  }
+
   fpt_rules * rules = fpt_rules_init();
+  fpt_rule_stats rule_stats = {0, NULL, NULL, NULL};
+
+  if (sweep) {
+    FILE * report = stdout;
+    if (report_fname != NULL && (report = fopen(report_fname, "w")) == NULL) {
+      fprintf(stderr, "unable to open '%s' for writing.\n", report_fname);
+      return EXIT_FAILURE;
+    }
+
+    int status = fpt_sweep(freq_itemsets, mine_time, supps, num_supps, confs, num_confs, use_index,
+        (max_rule_bytes > 0) ? max_rule_bytes : SWEEP_RULE_BYTES, report, ofname, backward_map);
+
+    if (report != stdout) {
+      fclose(report);
+    }
+    if (status != 0) {
+      return EXIT_FAILURE;
+    }
+  }
+  else if (max_rule_bytes > 0) {
+    FILE * fout = NULL;
+    if (ofname != NULL && (fout = fopen(ofname, "w")) == NULL) {
+      fprintf(stderr, "unable to open '%s' for writing.\n", ofname);
+      return EXIT_FAILURE;
+    }
+
+    start = monotonic_seconds();
+    long num_rules = fpt_gen_all_rules_streaming(freq_itemsets, min_conf, max_rule_bytes, fout, backward_map, &rule_stats);
+    printf("Rule generation: %0.04f seconds\n", monotonic_seconds()-start);
+    printf("Number of rules generated: %ld\n", num_rules);
+    if (verbose) {
+      fpt_print_rule_stats(&rule_stats);
+    }
 
-  if (min_supp > 20) {
+    if (fout != NULL) {
+      fclose(fout);
+    }
+  }
+  else if (gen_rules) {
     start = monotonic_seconds();
-    fpt_gen_all_rules(freq_itemsets, rules, min_conf);
+    if (num_threads > 1) {
+      fpt_gen_all_rules_parallel(freq_itemsets, rules, min_conf, &rule_stats);
+    }
+    else {
+      fpt_gen_all_rules(freq_itemsets, rules, min_conf, &rule_stats);
+    }
     printf("Rule generation: %0.04f seconds\n", monotonic_seconds()-start);
     printf("Number of rules generated: %d\n", rules->supp->num_elements);
+    if (verbose) {
+      fpt_print_rule_stats(&rule_stats);
+    }
   }
   else {
     fpt_create_empty_rules(freq_itemsets, rules);
   }
 
-  if (ofname != NULL) {
+  if (ofname != NULL && max_rule_bytes == 0 && !sweep) {
     fpt_write_rules_to_file(rules, ofname, backward_map);
   }
 
-  fpt_delete_tree(fp_tree);
-
+  free(rule_stats.generated);
+  free(rule_stats.pruned);
+  free(rule_stats.accepted);
+  free(supps);
+  free(confs);
   free(item_counts);
   free(forward_map);
   free(backward_map);
+  free(cons.required);
   fpt_freq_itemsets_free(freq_itemsets);
   fpt_rules_free(rules);
   fpt_free_csr(sorted_trans_csr);
 
+#ifdef FPT_MPI
+  MPI_Finalize();
+#endif
+
   return EXIT_SUCCESS;
 }